@@ -6,25 +6,631 @@
 //  .     .    .    .   . . .      .        .   |   .    .  .
 //
 
+#define _GNU_SOURCE // mremap
 #include <assert.h>
+#include <execinfo.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
+// debug builds fill fresh and freed memory with 0xAA so stale reads stand out,
+// like zig's safety mode. release (NDEBUG) builds skip every fill, so fresh
+// mmap'd pages stay untouched until the caller uses them.
+// -DZALLOC_SAFETY=0/1 overrides either way
+#ifndef ZALLOC_SAFETY
+#ifdef NDEBUG
+#define ZALLOC_SAFETY 0
+#else
+#define ZALLOC_SAFETY 1
+#endif
+#endif
+
+// past this a fill streams around the cache: a block that big only evicts
+// the working set, and non-temporal stores don't read its lines in first
+#define FILL_STREAM_MIN ((size_t)1 << 20)
+
+// memset, with sse2 non-temporal stores for big blocks
+static inline void fill_memory(void *ptr, int byte, size_t size) {
+#ifdef __SSE2__
+  if (size >= FILL_STREAM_MIN) {
+    char *p = ptr;
+    size_t head = -(uintptr_t)p & 15;
+    memset(p, byte, head);
+    p += head;
+    size -= head;
+    __m128i value = _mm_set1_epi8((char)byte);
+    for (char *end = p + (size & ~(size_t)63); p < end; p += 64) {
+      _mm_stream_si128((__m128i *)p, value);
+      _mm_stream_si128((__m128i *)(p + 16), value);
+      _mm_stream_si128((__m128i *)(p + 32), value);
+      _mm_stream_si128((__m128i *)(p + 48), value);
+    }
+    _mm_sfence(); // streaming stores aren't ordered with the ones after them
+    memset(p, byte, size & 63);
+    return;
+  }
+#endif
+  memset(ptr, byte, size);
+}
+
+static inline void poison(void *ptr, size_t size) {
+#if ZALLOC_SAFETY
+  fill_memory(ptr, 0xAA, size);
+#else
+  (void)ptr;
+  (void)size;
+#endif
+}
+
+// -DZALLOC_STATS=1 keeps counters on every allocator, read a snapshot with
+// vtable->stats. off by default: nothing is counted and stats reports zeros
+#ifndef ZALLOC_STATS
+#define ZALLOC_STATS 0
+#endif
+
+#if ZALLOC_STATS
+#define STAT(expr) (void)(expr)
+#else
+#define STAT(expr) ((void)0)
+#endif
+
+// live_bytes counts blocks as the allocator rounded them, requested_bytes
+// against rounded_bytes is the internal fragmentation
+typedef struct {
+  size_t live_bytes;
+  size_t peak_bytes; // high-water mark of live_bytes
+  size_t requested_bytes;
+  size_t rounded_bytes;
+  size_t allocs;
+  size_t frees;
+} AllocatorCounters;
+
+#define STATS_MAX_CLASSES 32
+
+typedef struct {
+  AllocatorCounters counters;
+  size_t chunks;                           // arena only
+  uint32_t class_pages[STATS_MAX_CLASSES]; // gpa pages per size class
+  // whole process, the shared page source included
+  size_t mmaps, munmaps, madvises, mremaps;
+} AllocatorStats;
+
+#if ZALLOC_STATS
+static struct {
+  _Atomic size_t mmaps, munmaps, madvises, mremaps;
+} syscall_stats;
+#endif
+
+#define STAT_SYSCALL(name)                                                     \
+  STAT(atomic_fetch_add_explicit(&syscall_stats.name, 1, memory_order_relaxed))
+
+static inline void counters_alloc(AllocatorCounters *counters,
+                                  size_t requested, size_t rounded) {
+  counters->requested_bytes += requested;
+  counters->rounded_bytes += rounded;
+  counters->allocs++;
+  counters->live_bytes += rounded;
+  if (counters->live_bytes > counters->peak_bytes)
+    counters->peak_bytes = counters->live_bytes;
+}
+
+static inline void counters_free(AllocatorCounters *counters, size_t size) {
+  counters->live_bytes -= size;
+  counters->frees++;
+}
+
+static inline void counters_resize(AllocatorCounters *counters,
+                                   size_t old_size, size_t new_size) {
+  counters->live_bytes += new_size - old_size;
+  if (counters->live_bytes > counters->peak_bytes)
+    counters->peak_bytes = counters->live_bytes;
+}
+
+// zeroes out and fills in what every snapshot shares
+static void stats_init(AllocatorStats *out) {
+  memset(out, 0, sizeof(*out));
+#if ZALLOC_STATS
+  out->mmaps = atomic_load(&syscall_stats.mmaps);
+  out->munmaps = atomic_load(&syscall_stats.munmaps);
+  out->madvises = atomic_load(&syscall_stats.madvises);
+  out->mremaps = atomic_load(&syscall_stats.mremaps);
+#endif
+}
+
+// transparent huge pages for segments, off by default since purging a single
+// 4K page out of a huge one splits it again. -DZALLOC_THP=1 to enable
+#ifndef ZALLOC_THP
+#define ZALLOC_THP 0
+#endif
+
+// a fresh mapping of its own, aligned to 1 << log2_align. mmap only guarantees
+// alignment to the mapping's page size, over-map and trim for anything
+// bigger. NULL if mmap fails
+static void *map_aligned(size_t size, uint8_t log2_align, size_t page_size,
+                         int flags) {
+  size_t alignment = (size_t)1 << log2_align;
+  if (size > SIZE_MAX / 4 || alignment > SIZE_MAX / 4)
+    return NULL; // no address space is that big
+  size = (size + page_size - 1) & ~(page_size - 1);
+  size_t slack = alignment > page_size ? alignment : 0;
+  STAT_SYSCALL(mmaps);
+  char *raw = mmap(NULL, size + slack, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  if (raw == MAP_FAILED)
+    return NULL;
+  if (slack == 0)
+    return raw;
+
+  char *page = (char *)(((uintptr_t)raw + alignment - 1) & ~(alignment - 1));
+  STAT_SYSCALL(munmaps);
+  if (page > raw)
+    munmap(raw, page - raw);
+  munmap(page + size, raw + slack - page);
+  return page;
+}
+
+// nothing is touched, the kernel commits each page on its first write
+static void *map_pages(size_t size, uint8_t log2_align) {
+  return map_aligned(size, log2_align, 4096, 0);
+}
+
+// for memory that has to stay a mapping of its own, large gpa blocks get
+// mremap'd and munmap'd directly
+static void *new_aligned_page_memory(size_t size, uint8_t log2_align) {
+  void *page = map_pages(size, log2_align);
+  if (page != NULL)
+    poison(page, size);
+  return page;
+}
+
+// 4 MiB regions aligned to their size, reserved in one mmap and handed out a
+// page run at a time. one vma per segment instead of one per page, and the
+// segment of any pointer inside is a single mask
+#define SEGMENT_LOG2 22
+#define SEGMENT_SIZE ((size_t)1 << SEGMENT_LOG2)
+#define SEGMENT_PAGES (SEGMENT_SIZE >> 12)
+
+static inline void *segment_of(void *ptr) {
+  return (void *)((uintptr_t)ptr & ~(uintptr_t)(SEGMENT_SIZE - 1));
+}
+
+// numa-aware page sourcing, off by default. with -DZALLOC_NUMA=1 every
+// segment is bound to the node of the thread that reserved it before any of
+// it is touched, and the page source keeps one list of segments per node so
+// arena chunks come from the calling thread's node. a gpa's segments belong
+// to the node of whichever thread needed a new one, that is local for a gpa
+// used by one thread. the thread-safe gpa refills every thread from one
+// central segment list, only the thread cache structs are node-local and the
+// slots in them can be on any node. mbind goes through syscall, no libnuma
+// needed
+#ifndef ZALLOC_NUMA
+#define ZALLOC_NUMA 0
+#endif
+
+#if ZALLOC_NUMA
+#define PAGE_NODES 64 // one bit each in the mbind node mask
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#else
+#define PAGE_NODES 1
+#endif
+
+// the node the calling thread runs on right now, getcpu is a vdso call
+static inline int page_node(void) {
+#if ZALLOC_NUMA
+  unsigned cpu, node;
+  if (getcpu(&cpu, &node) != 0 || node >= PAGE_NODES)
+    return 0;
+  return node;
+#else
+  return 0;
+#endif
+}
+
+static void *segment_reserve(int node) {
+  void *segment = map_pages(SEGMENT_SIZE, SEGMENT_LOG2);
+  if (segment == NULL)
+    return NULL;
+#if ZALLOC_THP
+  STAT_SYSCALL(madvises);
+  madvise(segment, SEGMENT_SIZE, MADV_HUGEPAGE);
+#endif
+#if ZALLOC_NUMA
+  // preferred, not bound: a full node falls back to another instead of oom.
+  // kernels without numa fail the call and first touch decides as before
+  unsigned long mask = 1UL << node;
+  syscall(SYS_mbind, segment, SEGMENT_SIZE, MPOL_PREFERRED, &mask,
+          PAGE_NODES + 1, 0);
+#else
+  (void)node;
+#endif
+  return segment;
+}
+
+static inline bool page_bit(const uint64_t *bits, size_t i) {
+  return bits[i >> 6] >> (i & 63) & 1;
+}
+
+static inline void page_bits_set(uint64_t *bits, size_t from, size_t count,
+                                 bool value) {
+  for (size_t i = from; i < from + count; i++) {
+    if (value)
+      bits[i >> 6] |= (uint64_t)1 << (i & 63);
+    else
+      bits[i >> 6] &= ~((uint64_t)1 << (i & 63));
+  }
+}
+
+// new_page_memory carves runs of up to 64 pages out of segments shared by the
+// whole process, arena chunks and thread caches stop costing a vma each.
+// bigger runs get their own mapping
+#define PAGE_RUN_MAX ((size_t)64 * 4096)
+
+typedef struct PageSegment {
+  struct PageSegment *next;
+  size_t free_count;
+  int node;
+  uint64_t used[SEGMENT_PAGES / 64]; // page 0 is this header
+} PageSegment;
+
+static struct {
+  pthread_mutex_t lock;
+  PageSegment *segments[PAGE_NODES];
+} page_source = {PTHREAD_MUTEX_INITIALIZER, {NULL}};
+
+// first fit, whole words of used pages are skipped
+static void *page_run_take(PageSegment *segment, size_t pages) {
+  size_t run = 0;
+  for (size_t i = 1; i < SEGMENT_PAGES; i++) {
+    if ((i & 63) == 0 && segment->used[i >> 6] == ~(uint64_t)0) {
+      i += 63;
+      run = 0;
+    } else if (page_bit(segment->used, i)) {
+      run = 0;
+    } else if (++run == pages) {
+      size_t first = i + 1 - pages;
+      page_bits_set(segment->used, first, pages, true);
+      segment->free_count -= pages;
+      return (char *)segment + (first << 12);
+    }
+  }
+  return NULL;
+}
+
+// a run from the segments, left as it is
+static void *page_source_take(size_t size) {
+  if (size > PAGE_RUN_MAX)
+    return map_pages(size, 12);
+  size = (size + 4095) & ~(size_t)4095;
+
+  size_t pages = size >> 12;
+  int node = page_node();
+  void *page = NULL;
+  pthread_mutex_lock(&page_source.lock);
+  for (PageSegment *segment = page_source.segments[node];
+       segment != NULL && page == NULL; segment = segment->next) {
+    if (segment->free_count >= pages)
+      page = page_run_take(segment, pages);
+  }
+  PageSegment *segment;
+  if (page == NULL && (segment = segment_reserve(node)) != NULL) {
+    segment->next = page_source.segments[node];
+    segment->free_count = SEGMENT_PAGES - 1;
+    segment->node = node;
+    segment->used[0] = 1;
+    page_source.segments[node] = segment;
+    page = page_run_take(segment, pages);
+  }
+  pthread_mutex_unlock(&page_source.lock);
+  return page;
+}
+
+// NULL once the kernel has no more pages to give
 static void *new_page_memory(size_t size) {
-  void *page = mmap(NULL, size, PROT_READ | PROT_WRITE,
-                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-  if (page == MAP_FAILED) {
-    perror("mmap failed");
-    exit(1);
+  void *page = page_source_take(size);
+  if (page != NULL)
+    poison(page, size);
+  return page;
+}
+
+// the run's memory goes back to the kernel right away, its segment is
+// unmapped once nothing is left in it, unless it is the last one
+static void free_page_memory(void *ptr, size_t size) {
+  size = (size + 4095) & ~(size_t)4095;
+  if (size > PAGE_RUN_MAX) {
+    STAT_SYSCALL(munmaps);
+    munmap(ptr, size);
+    return;
+  }
+
+  PageSegment *segment = segment_of(ptr);
+  size_t pages = size >> 12;
+  STAT_SYSCALL(madvises);
+  madvise(ptr, size, MADV_DONTNEED);
+
+  pthread_mutex_lock(&page_source.lock);
+  page_bits_set(segment->used, ((char *)ptr - (char *)segment) >> 12, pages,
+                false);
+  segment->free_count += pages;
+  PageSegment **segments = &page_source.segments[segment->node];
+  bool last_segment = *segments == segment && segment->next == NULL;
+  if (segment->free_count == SEGMENT_PAGES - 1 && !last_segment) {
+    PageSegment **link = segments;
+    while (*link != segment)
+      link = &(*link)->next;
+    *link = segment->next;
+    STAT_SYSCALL(munmaps);
+    munmap(segment, SEGMENT_SIZE);
+  }
+  pthread_mutex_unlock(&page_source.lock);
+}
+
+void test_page_memory(void) {
+  // small runs share a segment, freed runs are reused first fit
+  char *a = new_page_memory(4096);
+  char *b = new_page_memory(3 * 4096);
+  char *c = new_page_memory(4096);
+  assert(segment_of(a) == segment_of(b) && segment_of(b) == segment_of(c));
+  assert(((uintptr_t)a & 4095) == 0);
+  assert(a != segment_of(a)); // page 0 is the header
+  memset(b, 'b', 3 * 4096);
+  free_page_memory(b, 3 * 4096);
+  char *d = new_page_memory(2 * 4096);
+  assert(d == b);
+  assert(d[0] == (ZALLOC_SAFETY ? (char)0xAA : 0)); // madvise'd on free
+
+  // big runs are mappings of their own
+  char *e = new_page_memory(PAGE_RUN_MAX + 4096);
+  char *segment = segment_of(a);
+  assert(e < segment || e >= segment + SEGMENT_SIZE);
+  free_page_memory(e, PAGE_RUN_MAX + 4096);
+
+#if ZALLOC_NUMA
+  // the run's segment belongs to this thread's node and prefers it. the
+  // policy reads back as the default on kernels without numa
+  PageSegment *source = segment_of(a);
+  assert(source->node == page_node());
+  int mode = -1;
+  unsigned long mask = 0;
+  if (syscall(SYS_get_mempolicy, &mode, &mask, PAGE_NODES + 1, a, 2) == 0) {
+    assert(mode == MPOL_PREFERRED); // 2 is MPOL_F_ADDR, the policy at a
+    assert(mask == 1UL << source->node);
+  }
+#endif
+
+  free_page_memory(a, 4096);
+  free_page_memory(c, 4096);
+  free_page_memory(d, 2 * 4096);
+  printf("all page memory tests passed\n");
+}
+
+// alignments are log2, like zig's Alignment. 3 is 8 bytes, which is what
+// every allocator rounded to before alignment was a parameter
+#define DEFAULT_ALIGN 3
+
+// bigger than any address space, so such a request fails before rounding it
+// up could overflow
+#define ALLOC_SIZE_MAX (SIZE_MAX / 4)
+
+static inline void *align_forward(void *ptr, uint8_t log2_align) {
+  uintptr_t mask = ((uintptr_t)1 << log2_align) - 1;
+  return (void *)(((uintptr_t)ptr + mask) & ~mask);
+}
+
+// page allocators, like zig's page_allocator as the backing allocator of an
+// arena: where arena chunks and gpa segments come from. sizes get rounded to
+// page_size. nothing handed out is touched, whoever uses the pages poisons
+typedef struct PageAllocator PageAllocator;
+
+typedef struct {
+  void *(*map)(PageAllocator *self, size_t size, uint8_t log2_align);
+  void (*unmap)(PageAllocator *self, void *ptr, size_t size,
+                uint8_t log2_align);
+} PageAllocatorVTable;
+
+struct PageAllocator {
+  const PageAllocatorVTable *vtable;
+  size_t page_size;
+  bool zeroed; // map hands out pages that read as zero, fresh or purged
+};
+
+static inline size_t page_round(PageAllocator *pages, size_t size) {
+  return (size + pages->page_size - 1) & ~(pages->page_size - 1);
+}
+
+// the default: small runs from the shared segments, gpa segments and other
+// aligned requests as mappings of their own. runs are madvise'd when they go
+// back, so they come out zero again
+static void *default_pages_map(PageAllocator *self, size_t size,
+                               uint8_t log2_align) {
+  (void)self;
+  if (log2_align <= 12)
+    return page_source_take(size);
+  if (log2_align == SEGMENT_LOG2 && size == SEGMENT_SIZE)
+    return segment_reserve(page_node());
+  return map_pages(size, log2_align);
+}
+
+static void default_pages_unmap(PageAllocator *self, void *ptr, size_t size,
+                                uint8_t log2_align) {
+  (void)self;
+  if (log2_align <= 12) {
+    free_page_memory(ptr, size);
+    return;
+  }
+  STAT_SYSCALL(munmaps);
+  munmap(ptr, (size + 4095) & ~(size_t)4095);
+}
+
+const PageAllocatorVTable default_pages_vtable = {.map = default_pages_map,
+                                                  .unmap = default_pages_unmap};
+PageAllocator page_allocator = {&default_pages_vtable, 4096, true};
+
+// explicit 2 MiB hugetlb pages, one tlb entry for what took 512. needs pages
+// reserved in /proc/sys/vm/nr_hugepages, without them it falls back to
+// transparent huge pages on a 2 MiB aligned mapping
+#define HUGE_PAGE_LOG2 21
+#define HUGE_PAGE_SIZE ((size_t)1 << HUGE_PAGE_LOG2)
+
+static void *huge_pages_map(PageAllocator *self, size_t size,
+                            uint8_t log2_align) {
+  size = page_round(self, size);
+  if (log2_align < HUGE_PAGE_LOG2)
+    log2_align = HUGE_PAGE_LOG2;
+  void *page = map_aligned(size, log2_align, HUGE_PAGE_SIZE,
+                           MAP_HUGETLB | HUGE_PAGE_LOG2 << MAP_HUGE_SHIFT);
+  if (page != NULL)
+    return page;
+
+  page = map_pages(size, log2_align);
+  if (page != NULL) {
+    STAT_SYSCALL(madvises);
+    madvise(page, size, MADV_HUGEPAGE);
   }
-  memset(page, 0xAA, size);
   return page;
 }
 
+static void huge_pages_unmap(PageAllocator *self, void *ptr, size_t size,
+                             uint8_t log2_align) {
+  (void)log2_align;
+  STAT_SYSCALL(munmaps);
+  munmap(ptr, page_round(self, size));
+}
+
+const PageAllocatorVTable huge_pages_vtable = {.map = huge_pages_map,
+                                               .unmap = huge_pages_unmap};
+PageAllocator huge_page_allocator = {&huge_pages_vtable, HUGE_PAGE_SIZE, true};
+
+// a fixed region of pages, the caller's or a memfd's. the header and a bitmap
+// of used pages sit at the start of the region, runs are first fit
+typedef struct {
+  PageAllocator base;
+  pthread_mutex_t lock;
+  char *start; // first page handed out
+  size_t pages;
+  int fd;  // -1 unless memfd backed
+  uint64_t used[];
+} PageRegion;
+
+static void *region_pages_map(PageAllocator *self, size_t size,
+                              uint8_t log2_align) {
+  PageRegion *region = (PageRegion *)self;
+  if (size > region->pages << 12)
+    return NULL;
+  size_t pages = page_round(self, size) >> 12;
+  if (log2_align < 12)
+    log2_align = 12;
+
+  pthread_mutex_lock(&region->lock);
+  char *candidate = align_forward(region->start, log2_align);
+  size_t i = (candidate - region->start) >> 12;
+  while (i + pages <= region->pages) {
+    size_t run = 0;
+    while (run < pages && !page_bit(region->used, i + run))
+      run++;
+    if (run == pages) {
+      page_bits_set(region->used, i, pages, true);
+      pthread_mutex_unlock(&region->lock);
+      return region->start + (i << 12);
+    }
+    // the next aligned page past the used one
+    candidate = align_forward(region->start + ((i + run + 1) << 12), log2_align);
+    i = (candidate - region->start) >> 12;
+  }
+  pthread_mutex_unlock(&region->lock);
+  return NULL; // full, or too fragmented for the run
+}
+
+static void region_pages_unmap(PageAllocator *self, void *ptr, size_t size,
+                               uint8_t log2_align) {
+  (void)log2_align;
+  PageRegion *region = (PageRegion *)self;
+  size = page_round(self, size);
+  // shared memory only gives its pages back when they are removed
+  if (region->fd != -1) {
+    STAT_SYSCALL(madvises);
+    madvise(ptr, size, MADV_REMOVE);
+  }
+  pthread_mutex_lock(&region->lock);
+  page_bits_set(region->used, ((char *)ptr - region->start) >> 12, size >> 12,
+                false);
+  pthread_mutex_unlock(&region->lock);
+}
+
+const PageAllocatorVTable region_pages_vtable = {.map = region_pages_map,
+                                                 .unmap = region_pages_unmap};
+
+// the region's own header comes out of the buffer, the rest is handed out.
+// NULL if that leaves nothing
+PageAllocator *create_region_page_allocator(void *buffer, size_t size) {
+  char *base = align_forward(buffer, 12);
+  if ((size_t)(base - (char *)buffer) >= size)
+    return NULL;
+  size_t total = (size - (base - (char *)buffer)) >> 12;
+  size_t words = (total + 63) / 64;
+  size_t header = (sizeof(PageRegion) + words * 8 + 4095) >> 12;
+  if (total <= header)
+    return NULL;
+
+  PageRegion *region = (PageRegion *)base;
+  // not zeroed: the caller's memory is whatever it was, and madvise doesn't
+  // clear a shared page that is still in the memfd
+  region->base = (PageAllocator){&region_pages_vtable, 4096, false};
+  pthread_mutex_init(&region->lock, NULL);
+  region->start = base + (header << 12);
+  region->pages = total - header;
+  region->fd = -1;
+  memset(region->used, 0, words * 8);
+  return &region->base;
+}
+
+// the region over a memfd, for arenas in shared memory: another process maps
+// page_region_fd and finds a block at its offset from the region
+PageAllocator *create_memfd_page_allocator(const char *name, size_t size) {
+  int fd = memfd_create(name, MFD_CLOEXEC);
+  if (fd == -1)
+    return NULL;
+  STAT_SYSCALL(mmaps);
+  void *shared = MAP_FAILED;
+  if (ftruncate(fd, size) == 0)
+    shared = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  PageRegion *region = NULL;
+  if (shared != MAP_FAILED)
+    region = (PageRegion *)create_region_page_allocator(shared, size);
+  if (region == NULL) {
+    if (shared != MAP_FAILED)
+      munmap(shared, size);
+    close(fd);
+    return NULL;
+  }
+  region->fd = fd;
+  return &region->base;
+}
+
+int page_region_fd(PageAllocator *pages) { return ((PageRegion *)pages)->fd; }
+
+size_t page_region_offset(PageAllocator *pages, void *ptr) {
+  return (char *)ptr - (char *)pages;
+}
+
 typedef struct {
   void *ptr;
   size_t size;
@@ -33,41 +639,136 @@ typedef struct {
 typedef struct Allocator Allocator;
 
 // won't live on stack or heap but on a secret third thing
+// running out of memory is never fatal: alloc and remap hand back a NULL
+// block, resize false and alloc_many 0, and whatever the caller had is left
+// as it was
 typedef struct AllocatorVTable {
-  MemoryBlock (*alloc)(Allocator *self, size_t size);
+  MemoryBlock (*alloc)(Allocator *self, size_t size, uint8_t log2_align);
   void (*free)(Allocator *self, MemoryBlock memory);
-  bool (*resize)(Allocator *self, MemoryBlock *memory, size_t new_size);
+  bool (*resize)(Allocator *self, MemoryBlock *memory, uint8_t log2_align,
+                 size_t new_size);
+  // unlike resize this may move the block, the old block is gone afterwards
+  // unless the remap failed
+  MemoryBlock (*remap)(Allocator *self, MemoryBlock memory, uint8_t log2_align,
+                       size_t new_size);
+  void (*stats)(Allocator *self, AllocatorStats *out);
+  // count blocks of the same size in one call, one pointer each in out.
+  // returns the size every block got, what alloc would have put in .size.
+  // all or nothing, 0 if not every block fits
+  size_t (*alloc_many)(Allocator *self, size_t size, uint8_t log2_align,
+                       void **out, size_t count);
+  void (*free_many)(Allocator *self, size_t size, void **ptrs, size_t count);
+  // like calloc, the whole block reads as zero. memory fresh from the kernel
+  // is handed out as it is, only recycled memory gets cleared
+  MemoryBlock (*alloc_zeroed)(Allocator *self, size_t size,
+                              uint8_t log2_align);
 } AllocatorVTable;
 
 struct Allocator {
   const AllocatorVTable *vtable;
 };
 
+// remap for allocators that can't free a single block (fba, arena): grow in
+// place if the block is the last one, otherwise copy to a new block
+static MemoryBlock bump_remap(Allocator *self, MemoryBlock memory,
+                              uint8_t log2_align, size_t new_size) {
+  if (self->vtable->resize(self, &memory, log2_align, new_size))
+    return memory;
+  MemoryBlock moved = self->vtable->alloc(self, new_size, log2_align);
+  if (moved.ptr == NULL)
+    return moved;
+  size_t keep = memory.size < new_size ? memory.size : new_size;
+  memcpy(moved.ptr, memory.ptr, keep);
+  return moved;
+}
+
+// for allocators with nothing better to do than a loop
+static size_t generic_alloc_many(Allocator *self, size_t size,
+                                 uint8_t log2_align, void **out,
+                                 size_t count) {
+  MemoryBlock block = {NULL, size};
+  for (size_t i = 0; i < count; i++) {
+    block = self->vtable->alloc(self, size, log2_align);
+    if (block.ptr == NULL) {
+      for (size_t j = 0; j < i; j++) {
+        self->vtable->free(self, (MemoryBlock){out[j], size});
+      }
+      return 0;
+    }
+    out[i] = block.ptr;
+  }
+  return block.size;
+}
+
+static void generic_free_many(Allocator *self, size_t size, void **ptrs,
+                              size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    self->vtable->free(self, (MemoryBlock){ptrs[i], size});
+  }
+}
+
+// for allocators that can't tell fresh memory from recycled
+static MemoryBlock generic_alloc_zeroed(Allocator *self, size_t size,
+                                        uint8_t log2_align) {
+  MemoryBlock block = self->vtable->alloc(self, size, log2_align);
+  if (block.ptr != NULL)
+    fill_memory(block.ptr, 0, block.size);
+  return block;
+}
+
+// bump allocators hand out a run as one block split into strides, a stride
+// keeps every block aligned
+static inline size_t bump_stride(size_t size, uint8_t log2_align) {
+  size_t alignment = (size_t)1 << log2_align;
+  size = (size + 7) & ~(size_t)7; // 8-byte alignment
+  return (size + alignment - 1) & ~(alignment - 1);
+}
+
+static inline void bump_split(void *run, size_t stride, void **out,
+                              size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    out[i] = (char *)run + i * stride;
+  }
+}
+
 typedef struct {
   Allocator base;
   size_t size;
   void *offset;
+#if ZALLOC_STATS
+  AllocatorCounters counters; // a bump allocator's frees give nothing back
+#endif
 } FixedBufferAllocator;
 
-static MemoryBlock fixed_buffer_alloc(Allocator *self, size_t size) {
-  FixedBufferAllocator *fba = (FixedBufferAllocator *)self;
-  size = (size + 7) & ~7; // 8-byte alignment
-  if ((char *)fba->offset + size > (char *)fba + fba->size) {
-    perror("buffer stack oom");
-    exit(1);
-  }
-  void *ptr = fba->offset;
-  fba->offset = (char *)fba->offset + size;
-  return (MemoryBlock){ptr, size};
+// the typed entry point, for code that knows it has an fba. the whole bump
+// inlines into the caller. a NULL block when the buffer is full
+static inline MemoryBlock fba_alloc_inline(FixedBufferAllocator *fba,
+                                           size_t size, uint8_t log2_align) {
+  size_t rounded = (size + 7) & ~(size_t)7; // 8-byte alignment
+  // only pad as much as this offset needs, not a whole alignment
+  char *ptr = align_forward(fba->offset, log2_align);
+  char *end = (char *)fba + fba->size;
+  if (ptr > end || rounded > (size_t)(end - ptr) || rounded < size)
+    return (MemoryBlock){NULL, 0};
+  fba->offset = ptr + rounded;
+  STAT(counters_alloc(&fba->counters, size, rounded));
+  return (MemoryBlock){ptr, rounded};
+}
+
+static MemoryBlock fixed_buffer_alloc(Allocator *self, size_t size,
+                                      uint8_t log2_align) {
+  return fba_alloc_inline((FixedBufferAllocator *)self, size, log2_align);
 }
 
 static void fixed_buffer_free(Allocator *self, MemoryBlock memory) {
   (void)self;
   (void)memory;
+  STAT(((FixedBufferAllocator *)self)->counters.frees++);
 }
 
 static bool fixed_buffer_resize(Allocator *self, MemoryBlock *memory,
-                                size_t new_size) {
+                                uint8_t log2_align, size_t new_size) {
+  (void)log2_align; // resizing in place never moves the block
   FixedBufferAllocator *fba = (FixedBufferAllocator *)self;
   new_size = (new_size + 7) & ~7; // 8-byte alignment
 
@@ -80,17 +781,49 @@ static bool fixed_buffer_resize(Allocator *self, MemoryBlock *memory,
     return false;
 
   fba->offset = (char *)fba->offset - memory->size + new_size;
+  STAT(counters_resize(&fba->counters, memory->size, new_size));
   memory->size = new_size;
   return true;
 }
 
+static size_t fixed_buffer_alloc_many(Allocator *self, size_t size,
+                                      uint8_t log2_align, void **out,
+                                      size_t count) {
+  size_t stride = bump_stride(size, log2_align);
+  if (count == 0)
+    return stride;
+  if (count > SIZE_MAX / stride)
+    return 0;
+  MemoryBlock run = fixed_buffer_alloc(self, stride * count, log2_align);
+  if (run.ptr == NULL)
+    return 0;
+  bump_split(run.ptr, stride, out, count);
+  // the run was counted as one block
+  STAT(((FixedBufferAllocator *)self)->counters.allocs += count - 1);
+  STAT(((FixedBufferAllocator *)self)->counters.requested_bytes -=
+       (stride - size) * count);
+  return stride;
+}
+
+static void fixed_buffer_stats(Allocator *self, AllocatorStats *out) {
+  (void)self;
+  stats_init(out);
+  STAT(out->counters = ((FixedBufferAllocator *)self)->counters);
+}
+
 AllocatorVTable fixed_buffer_vtable = {.alloc = fixed_buffer_alloc,
                                        .free = fixed_buffer_free,
-                                       .resize = fixed_buffer_resize};
+                                       .resize = fixed_buffer_resize,
+                                       .remap = bump_remap,
+                                       .stats = fixed_buffer_stats,
+                                       .alloc_many = fixed_buffer_alloc_many,
+                                       .free_many = generic_free_many,
+                                       .alloc_zeroed = generic_alloc_zeroed};
 
 Allocator *create_fixed_buffer_allocator(void *buffer, size_t size) {
   FixedBufferAllocator *fba = (FixedBufferAllocator *)buffer;
   fba->base.vtable = &fixed_buffer_vtable;
+  STAT(memset(&fba->counters, 0, sizeof(fba->counters)));
   fba->size = size;
   fba->offset = (char *)buffer + sizeof(FixedBufferAllocator);
   return (Allocator *)fba;
@@ -99,15 +832,15 @@ Allocator *create_fixed_buffer_allocator(void *buffer, size_t size) {
 void test_fba(Allocator *allocator) {
   FixedBufferAllocator *fba = (FixedBufferAllocator *)allocator;
 
-  MemoryBlock str1 = allocator->vtable->alloc(allocator, 20);
+  MemoryBlock str1 = allocator->vtable->alloc(allocator, 20, DEFAULT_ALIGN);
   assert(str1.ptr != NULL);
   memcpy(str1.ptr, "aaaaaaaaaaaaaaaaaaa\0", 20);
   assert(str1.size == 24);
   assert(strlen(str1.ptr) == 19);
   assert(((char *)str1.ptr)[20] == (char)0xAA);
 
-  MemoryBlock str2 = allocator->vtable->alloc(allocator, 11);
-  bool resize1 = allocator->vtable->resize(allocator, &str1, 1);
+  MemoryBlock str2 = allocator->vtable->alloc(allocator, 11, DEFAULT_ALIGN);
+  bool resize1 = allocator->vtable->resize(allocator, &str1, DEFAULT_ALIGN, 1);
   assert(resize1 == false); // only last allocation can resize
   assert(str2.ptr != NULL);
   assert(str2.size == 16);
@@ -116,12 +849,12 @@ void test_fba(Allocator *allocator) {
   assert(strlen(str2.ptr) == 10);
   assert(((char *)str2.ptr)[11] == (char)0xAA);
 
-  bool resize2 = allocator->vtable->resize(allocator, &str2, 5);
+  bool resize2 = allocator->vtable->resize(allocator, &str2, DEFAULT_ALIGN, 5);
   assert(resize2 == true);
   assert(str2.size == 8);
   assert(fba->offset == (void *)((char *)str2.ptr + str2.size));
 
-  MemoryBlock str3 = allocator->vtable->alloc(allocator, 2);
+  MemoryBlock str3 = allocator->vtable->alloc(allocator, 2, DEFAULT_ALIGN);
   assert(str3.ptr != NULL);
   // should be right after the resized str2
   assert(str3.ptr == (char *)str2.ptr + 8);
@@ -130,165 +863,4576 @@ void test_fba(Allocator *allocator) {
   assert(strlen(str3.ptr) == 1);
   assert((char *)str3.ptr + 8 == (char *)fba->offset);
 
+  // over-aligned blocks only pad what the current offset needs
+  MemoryBlock aligned = allocator->vtable->alloc(allocator, 8, 6);
+  assert((uintptr_t)aligned.ptr % 64 == 0);
+  assert((char *)aligned.ptr - ((char *)str3.ptr + 8) < 64);
+  MemoryBlock str4 = allocator->vtable->alloc(allocator, 1, DEFAULT_ALIGN);
+  assert(str4.ptr == (char *)aligned.ptr + 8);
+
+  // remap grows the last block in place, copies anything else
+  memcpy(str4.ptr, "q", 1);
+  MemoryBlock str5 =
+      allocator->vtable->remap(allocator, str4, DEFAULT_ALIGN, 40);
+  assert(str5.ptr == str4.ptr);
+  assert(str5.size == 40);
+  MemoryBlock str6 =
+      allocator->vtable->remap(allocator, str3, DEFAULT_ALIGN, 16);
+  assert(str6.ptr == (char *)str5.ptr + 40);
+  assert(strcmp(str6.ptr, "z") == 0);
+
   printf("all fixed buffer allocator tests passed\n");
 }
 
-// arena is linked list of pages
-typedef struct ArenaAllocator {
+// thread-safe fba, like zig's FixedBufferAllocator.threadSafeAllocator: the
+// offset only moves by compare-and-swap, so threads can share one buffer
+// without a lock. resize still only works on the last block, whoever
+// allocated it. no counters, stats reports zeros
+typedef struct {
   Allocator base;
+  size_t size;
+  _Atomic(char *) offset;
+} ThreadSafeFixedBufferAllocator;
+
+static MemoryBlock ts_fixed_buffer_alloc(Allocator *self, size_t size,
+                                         uint8_t log2_align) {
+  ThreadSafeFixedBufferAllocator *fba = (ThreadSafeFixedBufferAllocator *)self;
+  size_t rounded = (size + 7) & ~(size_t)7; // 8-byte alignment
+  if (rounded < size)
+    return (MemoryBlock){NULL, 0};
+  size = rounded;
+  char *end = (char *)fba + fba->size;
+  char *old = atomic_load_explicit(&fba->offset, memory_order_relaxed);
+  char *ptr;
+  do {
+    ptr = align_forward(old, log2_align);
+    if (ptr > end || size > (size_t)(end - ptr))
+      return (MemoryBlock){NULL, 0};
+  } while (!atomic_compare_exchange_weak_explicit(
+      &fba->offset, &old, ptr + size, memory_order_relaxed,
+      memory_order_relaxed));
+  return (MemoryBlock){ptr, size};
+}
+
+static void ts_fixed_buffer_free(Allocator *self, MemoryBlock memory) {
+  (void)self;
+  (void)memory;
+}
+
+static bool ts_fixed_buffer_resize(Allocator *self, MemoryBlock *memory,
+                                   uint8_t log2_align, size_t new_size) {
+  (void)log2_align; // resizing in place never moves the block
+  ThreadSafeFixedBufferAllocator *fba = (ThreadSafeFixedBufferAllocator *)self;
+  new_size = (new_size + 7) & ~7; // 8-byte alignment
+  if ((char *)memory->ptr + new_size > (char *)fba + fba->size)
+    return false;
+
+  // only succeeds if nobody allocated after this block
+  char *last_end = (char *)memory->ptr + memory->size;
+  if (!atomic_compare_exchange_strong_explicit(
+          &fba->offset, &last_end, (char *)memory->ptr + new_size,
+          memory_order_relaxed, memory_order_relaxed))
+    return false;
+  memory->size = new_size;
+  return true;
+}
+
+// one compare-and-swap for the whole run
+static size_t ts_fixed_buffer_alloc_many(Allocator *self, size_t size,
+                                         uint8_t log2_align, void **out,
+                                         size_t count) {
+  size_t stride = bump_stride(size, log2_align);
+  if (count == 0)
+    return stride;
+  if (count > SIZE_MAX / stride)
+    return 0;
+  MemoryBlock run = ts_fixed_buffer_alloc(self, stride * count, log2_align);
+  if (run.ptr == NULL)
+    return 0;
+  bump_split(run.ptr, stride, out, count);
+  return stride;
+}
+
+static void ts_fixed_buffer_stats(Allocator *self, AllocatorStats *out) {
+  (void)self;
+  stats_init(out);
+}
+
+AllocatorVTable ts_fixed_buffer_vtable = {.alloc = ts_fixed_buffer_alloc,
+                                          .free = ts_fixed_buffer_free,
+                                          .resize = ts_fixed_buffer_resize,
+                                          .remap = bump_remap,
+                                          .stats = ts_fixed_buffer_stats,
+                                          .alloc_many =
+                                              ts_fixed_buffer_alloc_many,
+                                          .free_many = generic_free_many,
+                                          .alloc_zeroed = generic_alloc_zeroed};
+
+Allocator *create_thread_safe_fixed_buffer_allocator(void *buffer,
+                                                     size_t size) {
+  ThreadSafeFixedBufferAllocator *fba = buffer;
+  fba->base.vtable = &ts_fixed_buffer_vtable;
+  fba->size = size;
+  atomic_init(&fba->offset,
+              (char *)buffer + sizeof(ThreadSafeFixedBufferAllocator));
+  return (Allocator *)fba;
+}
+
+typedef struct {
+  Allocator *allocator;
+  int id;
+  MemoryBlock blocks[1000];
+} FBATestWorker;
+
+static void *fba_test_worker(void *arg) {
+  FBATestWorker *worker = (FBATestWorker *)arg;
+  for (int i = 0; i < 1000; i++) {
+    size_t size = 8 + (i % 7) * 8;
+    worker->blocks[i] =
+        worker->allocator->vtable->alloc(worker->allocator, size, i % 5);
+    memset(worker->blocks[i].ptr, worker->id, worker->blocks[i].size);
+  }
+  return NULL;
+}
+
+void test_fba_thread_safe(void) {
+  size_t size = 1 << 20;
+  void *buffer = new_page_memory(size);
+  Allocator *allocator = create_thread_safe_fixed_buffer_allocator(buffer, size);
+
+  // the last block grows and shrinks in place, anything else doesn't
+  MemoryBlock str1 = allocator->vtable->alloc(allocator, 20, DEFAULT_ALIGN);
+  assert(str1.size == 24);
+  assert(allocator->vtable->resize(allocator, &str1, DEFAULT_ALIGN, 100));
+  assert(str1.size == 104);
+  MemoryBlock str2 = allocator->vtable->alloc(allocator, 8, DEFAULT_ALIGN);
+  assert(str2.ptr == (char *)str1.ptr + 104);
+  assert(!allocator->vtable->resize(allocator, &str1, DEFAULT_ALIGN, 8));
+  assert(!allocator->vtable->resize(allocator, &str2, DEFAULT_ALIGN, size));
+
+  // concurrent bumps never hand out overlapping blocks
+  static FBATestWorker workers[4];
+  pthread_t threads[4];
+  for (int t = 0; t < 4; t++) {
+    workers[t].allocator = allocator;
+    workers[t].id = t + 1;
+    pthread_create(&threads[t], NULL, fba_test_worker, &workers[t]);
+  }
+  for (int t = 0; t < 4; t++) {
+    pthread_join(threads[t], NULL);
+  }
+  for (int t = 0; t < 4; t++) {
+    for (int i = 0; i < 1000; i++) {
+      MemoryBlock block = workers[t].blocks[i];
+      assert((uintptr_t)block.ptr % ((uintptr_t)1 << (i % 5)) == 0);
+      for (size_t j = 0; j < block.size; j++) {
+        assert(((unsigned char *)block.ptr)[j] == t + 1);
+      }
+    }
+  }
+
+  free_page_memory(buffer, size);
+  printf("all thread-safe fixed buffer allocator tests passed\n");
+}
+
+// arena is linked list of chunks, allocation bumps the current one and every
+// new chunk is twice the size of the last until ARENA_MAX_CHUNK
+#define ARENA_MIN_CHUNK 4096
+#define ARENA_MAX_CHUNK (256 * 4096)
+
+typedef struct ArenaChunk {
+  struct ArenaChunk *next;
+  size_t size; // mapped bytes, header included
   void *offset;
-  struct ArenaAllocator *next;
+  size_t serial; // when the chunk last went from empty to in use
+  // past both this and offset the chunk still reads as zero from its pages.
+  // its end if they didn't come zeroed or got poisoned
+  void *clean;
+} ArenaChunk;
+
+typedef struct ArenaAllocator {
+  Allocator base;
+  ArenaChunk *first; // the arena itself lives here
+  ArenaChunk *current;
+  size_t chunk_size; // size of the next regular chunk
+  size_t serial;     // bumped whenever a chunk starts getting used
+  PageAllocator *pages;
+  size_t mapped;       // every chunk, the headers and the arena included
+  size_t memory_limit; // no new chunk past this many mapped bytes
+#if ZALLOC_STATS
+  AllocatorCounters counters; // peak_bytes is the high-water mark
+  size_t chunks;
+#endif
 } ArenaAllocator;
 
-static MemoryBlock arena_alloc(Allocator *self, size_t size) {
-  if (size <= 0 || size > 4096) {
-    perror("mmap failed");
+// sizes round up to the page allocator's pages, the chunk gets all of it.
+// NULL past limit bytes or when the pages ran out
+static ArenaChunk *arena_new_chunk(PageAllocator *pages, size_t size,
+                                   size_t limit) {
+  size = page_round(pages, size);
+  if (size > limit)
+    return NULL;
+  ArenaChunk *chunk = pages->vtable->map(pages, size, 12);
+  if (chunk == NULL)
+    return NULL;
+  poison(chunk, size);
+  chunk->next = NULL;
+  chunk->size = size;
+  chunk->serial = 0;
+  size_t chunk_header = (sizeof(ArenaChunk) + 7) & ~7; // 8-byte alignment
+  chunk->offset = (char *)chunk + chunk_header;
+  chunk->clean = ZALLOC_SAFETY || !pages->zeroed ? (char *)chunk + size
+                                                  : chunk->offset;
+  return chunk;
+}
+
+// moves the chunk's offset back, what was handed out past it isn't zero
+// anymore
+static void arena_chunk_rewind(ArenaChunk *chunk, void *offset) {
+  if ((char *)chunk->offset > (char *)chunk->clean)
+    chunk->clean = chunk->offset;
+  poison(offset, (char *)chunk->offset - (char *)offset);
+  chunk->offset = offset;
+}
+
+// bumps chunk if the aligned block fits, NULL otherwise
+static void *arena_chunk_bump(ArenaChunk *chunk, size_t size,
+                              uint8_t log2_align) {
+  char *ptr = align_forward(chunk->offset, log2_align);
+  char *end = (char *)chunk + chunk->size;
+  if (ptr > end || size > (size_t)(end - ptr))
+    return NULL;
+  chunk->offset = ptr + size;
+  return ptr;
+}
+
+static void *arena_chunk_start(ArenaAllocator *arena, ArenaChunk *chunk) {
+  size_t chunk_header = (sizeof(ArenaChunk) + 7) & ~7; // 8-byte alignment
+  size_t arena_size = (sizeof(ArenaAllocator) + 7) & ~7;
+  char *start = (char *)chunk + chunk_header;
+  return chunk == arena->first ? start + arena_size : start;
+}
+
+static MemoryBlock arena_alloc(Allocator *self, size_t size,
+                               uint8_t log2_align) {
+  if (size <= 0) {
+    perror("invalid allocation size");
     exit(1);
   }
+  if (size > ALLOC_SIZE_MAX)
+    return (MemoryBlock){NULL, 0};
 
   ArenaAllocator *arena = (ArenaAllocator *)self;
+#if ZALLOC_STATS
+  size_t requested = size;
+#endif
   size = (size + 7) & ~7; // 8-byte alignment
 
-  // try to find space in existing pages
-  ArenaAllocator *current = arena;
-  while (current != NULL) {
-    if (current->offset + size <= (void *)self + 4096) {
-      void *ptr = current->offset;
-      current->offset = (char *)current->offset + size;
-      return (MemoryBlock){ptr, size};
-    }
-    current = current->next;
+  ArenaChunk *current = arena->current;
+  void *ptr = arena_chunk_bump(current, size, log2_align);
+  if (ptr != NULL) {
+    STAT(counters_alloc(&arena->counters, requested, size));
+    return (MemoryBlock){ptr, size};
   }
 
-  ArenaAllocator *new_arena = new_page_memory(4096);
-  new_arena->base = arena->base;
-  size_t arena_size = (sizeof(ArenaAllocator) + 7) & ~7;
-  new_arena->offset = (void *)new_arena + arena_size;
-  new_arena->next = NULL;
+  // a fresh chunk only needs padding past the header for alignments over 8
+  size_t chunk_header = (sizeof(ArenaChunk) + 7) & ~7;
+  size_t alignment = (size_t)1 << log2_align;
+  size_t needed = chunk_header + size + (alignment > 8 ? alignment - 8 : 0);
+  bool oversized = needed > arena->chunk_size;
+
+  // empty chunks are all after the current one, kept by a reset or a
+  // restore. the smallest one the block fits in is used before mapping more
+  ArenaChunk **best = NULL;
+  for (ArenaChunk **link = &current->next; *link != NULL;
+       link = &(*link)->next) {
+    ArenaChunk *kept = *link;
+    if (kept->offset == arena_chunk_start(arena, kept) &&
+        kept->size >= needed && (best == NULL || kept->size < (*best)->size))
+      best = link;
+  }
 
-  current = arena;
-  while (current->next != NULL) {
-    current = current->next;
+  ArenaChunk *chunk;
+  if (best != NULL) {
+    chunk = *best;
+    *best = chunk->next;
+  } else {
+    size_t limit = arena->memory_limit > arena->mapped
+                       ? arena->memory_limit - arena->mapped
+                       : 0;
+    chunk = arena_new_chunk(
+        arena->pages, oversized ? needed : arena->chunk_size, limit);
+    if (chunk == NULL)
+      return (MemoryBlock){NULL, 0};
+    if (!oversized && arena->chunk_size < ARENA_MAX_CHUNK)
+      arena->chunk_size *= 2;
+    arena->mapped += chunk->size;
+    STAT(arena->chunks++);
   }
-  current->next = new_arena;
 
-  void *ptr = new_arena->offset;
-  new_arena->offset = (char *)new_arena->offset + size;
+  // chunks in use go right after the current one, ahead of the empty ones.
+  // an oversized block gets a dedicated chunk and the current one keeps
+  // bumping
+  if (!oversized)
+    arena->current = chunk;
+  chunk->next = current->next;
+  chunk->serial = ++arena->serial;
+  current->next = chunk;
+
+  ptr = arena_chunk_bump(chunk, size, log2_align);
+  STAT(counters_alloc(&arena->counters, requested, size));
   return (MemoryBlock){ptr, size};
 }
 
+// the typed entry point: a bump of the current chunk inlines into the caller,
+// anything else goes out of line to arena_alloc, which tries the current
+// chunk once more before moving on
+static inline MemoryBlock arena_alloc_inline(ArenaAllocator *arena,
+                                             size_t size, uint8_t log2_align) {
+  size_t rounded = (size + 7) & ~(size_t)7; // 8-byte alignment
+  void *ptr;
+  // one compare for both 0 and oversized, arena_alloc deals with those
+  if (__builtin_expect(size - 1 < ALLOC_SIZE_MAX, 1) &&
+      (ptr = arena_chunk_bump(arena->current, rounded, log2_align))) {
+    STAT(counters_alloc(&arena->counters, size, rounded));
+    return (MemoryBlock){ptr, rounded};
+  }
+  return arena_alloc(&arena->base, size, log2_align);
+}
+
+// only memory a reset, restore or shrink gave back needs clearing, the rest
+// of a chunk is as zero as its pages came
+static MemoryBlock arena_alloc_zeroed(Allocator *self, size_t size,
+                                      uint8_t log2_align) {
+  ArenaAllocator *arena = (ArenaAllocator *)self;
+  MemoryBlock block = arena_alloc(self, size, log2_align);
+  if (block.ptr == NULL)
+    return block;
+  // in the current chunk, or in an oversized one right after it
+  ArenaChunk *chunk = arena->current;
+  char *ptr = block.ptr;
+  if (ptr < (char *)chunk || ptr >= (char *)chunk + chunk->size)
+    chunk = chunk->next;
+  char *clean = chunk->clean;
+  if (clean > ptr + block.size)
+    clean = ptr + block.size;
+  if (ptr < clean)
+    fill_memory(ptr, 0, clean - ptr);
+  return block;
+}
+
 void arena_free(Allocator *allocator, MemoryBlock memory) {
   (void)memory;
   ArenaAllocator *arena = (ArenaAllocator *)allocator;
-  while (arena) {
-    ArenaAllocator *next = arena->next;
-    munmap(arena, 4096);
-    arena = next;
+  PageAllocator *pages = arena->pages; // the arena goes with the first chunk
+  ArenaChunk *chunk = arena->first;
+  while (chunk) {
+    ArenaChunk *next = chunk->next;
+    pages->vtable->unmap(pages, chunk, chunk->size, 12);
+    chunk = next;
   }
 }
 
 static bool arena_resize(Allocator *self, MemoryBlock *memory,
-                         size_t new_size) {
+                         uint8_t log2_align, size_t new_size) {
+  (void)log2_align; // resizing in place never moves the block
   ArenaAllocator *arena = (ArenaAllocator *)self;
+  ArenaChunk *current = arena->current;
   new_size = (new_size + 7) & ~7; // 8-byte alignment
 
-  bool last_alloc = (char *)memory->ptr + memory->size == arena->offset;
-  bool oom = (char *)memory->ptr + new_size > (char *)arena + 4096;
+  bool last_alloc = (char *)memory->ptr + memory->size == current->offset;
+  bool oom = (char *)memory->ptr + new_size > (char *)current + current->size;
   if (!last_alloc || oom)
     return false;
 
-  arena->offset = (char *)memory->ptr + new_size;
+  if ((char *)current->offset > (char *)current->clean)
+    current->clean = current->offset; // a shrink leaves the tail dirty
+  current->offset = (char *)memory->ptr + new_size;
+  STAT(counters_resize(&arena->counters, memory->size, new_size));
   memory->size = new_size;
   return true;
 }
 
-AllocatorVTable arena_vtable = {
-    .alloc = arena_alloc, .free = arena_free, .resize = arena_resize};
+// one bump for the whole run
+static size_t arena_alloc_many(Allocator *self, size_t size,
+                               uint8_t log2_align, void **out, size_t count) {
+  size_t stride = bump_stride(size, log2_align);
+  if (count == 0)
+    return stride;
+  if (count > SIZE_MAX / stride)
+    return 0;
+  MemoryBlock run = arena_alloc(self, stride * count, log2_align);
+  if (run.ptr == NULL)
+    return 0;
+  bump_split(run.ptr, stride, out, count);
+  // the run was counted as one block
+  STAT(((ArenaAllocator *)self)->counters.allocs += count - 1);
+  STAT(((ArenaAllocator *)self)->counters.requested_bytes -=
+       (stride - size) * count);
+  return stride;
+}
 
-Allocator *create_arena_allocator() {
-  ArenaAllocator *arena = new_page_memory(4096);
-  arena->base.vtable = &arena_vtable;
-  size_t arena_size = (sizeof(ArenaAllocator) + 7) & ~7; // 8-byte alignment
-  arena->offset = arena + arena_size;
-  arena->next = NULL;
-  return (Allocator *)arena;
+// free on an arena lets go of every chunk, blocks one by one stay put until
+// then
+static void arena_free_many(Allocator *self, size_t size, void **ptrs,
+                            size_t count) {
+  (void)self;
+  (void)size;
+  (void)ptrs;
+  (void)count;
 }
 
-void test_arena(Allocator *allocator) {
-  ArenaAllocator *arena = (ArenaAllocator *)allocator;
+static void arena_stats(Allocator *self, AllocatorStats *out) {
+  (void)self;
+  stats_init(out);
+  STAT(out->counters = ((ArenaAllocator *)self)->counters);
+  STAT(out->chunks = ((ArenaAllocator *)self)->chunks);
+}
 
-  MemoryBlock str1 = allocator->vtable->alloc(allocator, 20);
-  assert(str1.ptr != NULL);
-  assert(str1.size == 24);
-  memcpy(str1.ptr, "aaaaaaaaaaaaaaaaaaa\0", 20);
-  assert(strlen(str1.ptr) == 19);
-  assert(((char *)str1.ptr)[24] == (char)0xAA);
+AllocatorVTable arena_vtable = {.alloc = arena_alloc,
+                                .free = arena_free,
+                                .resize = arena_resize,
+                                .remap = bump_remap,
+                                .stats = arena_stats,
+                                .alloc_many = arena_alloc_many,
+                                .free_many = arena_free_many,
+                                .alloc_zeroed = arena_alloc_zeroed};
 
-  MemoryBlock str2 = allocator->vtable->alloc(allocator, 11);
-  bool resize1 = allocator->vtable->resize(allocator, &str1, 1);
-  assert(resize1 == false);
-  assert(str2.ptr != NULL);
-  assert(str2.size == 16);
-  assert(str2.ptr == (char *)str1.ptr + 24); // 8-byte alignment
-  memcpy(str2.ptr, "xxxxxxxxxx\0", 11);
-  assert(strlen(str2.ptr) == 10);
+// like zig's ArenaAllocator.reset, what to do with the chunks on reset
+typedef enum {
+  ARENA_FREE_ALL,          // unmap everything but the first chunk
+  ARENA_RETAIN_CAPACITY,   // keep every chunk mapped
+  ARENA_RETAIN_WITH_LIMIT, // keep chunks until their total size hits limit
+} ArenaResetMode;
 
-  bool resize2 = allocator->vtable->resize(allocator, &str2, 5);
-  assert(resize2 == true);
-  assert(arena->offset == (char *)str2.ptr + str2.size);
+// rewinds every retained chunk so the next allocation starts at the first
+// chunk again, on memory that is already faulted in
+void arena_reset(Allocator *allocator, ArenaResetMode mode, size_t limit) {
+  ArenaAllocator *arena = (ArenaAllocator *)allocator;
+  if (mode == ARENA_FREE_ALL)
+    limit = arena->first->size;
 
-  MemoryBlock str3 = allocator->vtable->alloc(allocator, 2);
+  size_t retained = 0;
+  ArenaChunk *prev = NULL;
+  ArenaChunk *chunk = arena->first;
+  while (chunk != NULL) {
+    ArenaChunk *next = chunk->next;
+    bool keep = chunk == arena->first || mode == ARENA_RETAIN_CAPACITY ||
+                retained + chunk->size <= limit;
+    if (!keep) {
+      prev->next = next;
+      arena->mapped -= chunk->size;
+      STAT(arena->chunks--);
+      arena->pages->vtable->unmap(arena->pages, chunk, chunk->size, 12);
+      chunk = next;
+      continue;
+    }
+
+    arena_chunk_rewind(chunk, arena_chunk_start(arena, chunk));
+    retained += chunk->size;
+    prev = chunk;
+    chunk = next;
+  }
+
+  arena->current = arena->first;
+  STAT(arena->counters.live_bytes = 0);
+  if (mode == ARENA_FREE_ALL)
+    arena->chunk_size = ARENA_MIN_CHUNK * 2;
+}
+
+// a point to roll the arena back to, like a temp scope: everything allocated
+// after arena_save is gone after arena_restore, everything before stays.
+// savepoints nest, restoring one drops those taken after it
+typedef struct {
+  ArenaChunk *chunk;
+  void *offset;
+  size_t serial;
+#if ZALLOC_STATS
+  size_t live_bytes;
+#endif
+} ArenaSavepoint;
+
+ArenaSavepoint arena_save(Allocator *allocator) {
+  ArenaAllocator *arena = (ArenaAllocator *)allocator;
+  ArenaSavepoint savepoint = {.chunk = arena->current,
+                              .offset = arena->current->offset,
+                              .serial = arena->serial};
+  STAT(savepoint.live_bytes = arena->counters.live_bytes);
+  return savepoint;
+}
+
+// the current chunk goes back to the saved offset. chunks that started
+// getting used after the save are rewound and stay mapped for the next scope,
+// so only those cost anything, the common case is two stores
+void arena_restore(Allocator *allocator, ArenaSavepoint savepoint) {
+  ArenaAllocator *arena = (ArenaAllocator *)allocator;
+  ArenaChunk *saved = savepoint.chunk;
+  arena_chunk_rewind(saved, savepoint.offset);
+  arena->current = saved;
+  if (arena->serial == savepoint.serial) {
+    STAT(arena->counters.live_bytes = savepoint.live_bytes);
+    return;
+  }
+
+  // newer chunks only ever go after the current one. the rewound ones move up
+  // to right after the saved chunk, where arena_alloc looks for empty chunks
+  ArenaChunk *rewound = NULL, **tail = &rewound;
+  ArenaChunk *prev = saved;
+  ArenaChunk *chunk = saved->next;
+  while (chunk != NULL) {
+    ArenaChunk *next = chunk->next;
+    if (chunk->serial > savepoint.serial) {
+      arena_chunk_rewind(chunk, arena_chunk_start(arena, chunk));
+      prev->next = next;
+      *tail = chunk;
+      tail = &chunk->next;
+    } else {
+      prev = chunk;
+    }
+    chunk = next;
+  }
+  *tail = saved->next;
+  saved->next = rewound;
+  STAT(arena->counters.live_bytes = savepoint.live_bytes);
+}
+
+// an arena whose chunks come from pages, huge pages or a shared region.
+// NULL if not even the first chunk can be mapped
+Allocator *create_arena_allocator_with_pages(PageAllocator *pages) {
+  ArenaChunk *chunk = arena_new_chunk(pages, ARENA_MIN_CHUNK, SIZE_MAX);
+  if (chunk == NULL)
+    return NULL;
+  ArenaAllocator *arena = chunk->offset;
+  size_t arena_size = (sizeof(ArenaAllocator) + 7) & ~7; // 8-byte alignment
+  chunk->offset = (char *)chunk->offset + arena_size;
+  arena->base.vtable = &arena_vtable;
+  arena->first = chunk;
+  arena->current = chunk;
+  arena->chunk_size = ARENA_MIN_CHUNK * 2;
+  arena->serial = 0;
+  arena->pages = pages;
+  arena->mapped = chunk->size;
+  arena->memory_limit = SIZE_MAX;
+  STAT(memset(&arena->counters, 0, sizeof(arena->counters)));
+  STAT(arena->chunks = 1);
+  return (Allocator *)arena;
+}
+
+Allocator *create_arena_allocator() {
+  return create_arena_allocator_with_pages(&page_allocator);
+}
+
+// like zig's requested_memory_limit, but counting what the arena maps: once
+// its chunks would go past limit bytes, alloc hands back NULL blocks. the
+// chunks already mapped stay, a limit below them only stops new ones
+void arena_set_memory_limit(Allocator *allocator, size_t limit) {
+  ((ArenaAllocator *)allocator)->memory_limit = limit;
+}
+
+// the polymorphic case, one indirect call
+static inline MemoryBlock allocator_alloc(Allocator *allocator, size_t size,
+                                          uint8_t log2_align) {
+  return allocator->vtable->alloc(allocator, size, log2_align);
+}
+
+// picks the entry point from the pointer's static type: a concrete allocator
+// gets its inlined fast path, a plain Allocator * goes through the vtable.
+// either way the block is the same one the vtable would have handed out
+#define zalloc(allocator, size, log2_align)                                    \
+  _Generic((allocator),                                                        \
+      FixedBufferAllocator *: fba_alloc_inline,                                \
+      ArenaAllocator *: arena_alloc_inline,                                    \
+      default: allocator_alloc)((allocator), (size), (log2_align))
+
+void test_arena(Allocator *allocator) {
+  ArenaAllocator *arena = (ArenaAllocator *)allocator;
+  size_t chunk_header = (sizeof(ArenaChunk) + 7) & ~7; // 8-byte alignment
+
+  MemoryBlock str1 = allocator->vtable->alloc(allocator, 20, DEFAULT_ALIGN);
+  assert(str1.ptr != NULL);
+  assert(str1.size == 24);
+  memcpy(str1.ptr, "aaaaaaaaaaaaaaaaaaa\0", 20);
+  assert(strlen(str1.ptr) == 19);
+  assert(!ZALLOC_SAFETY || ((char *)str1.ptr)[24] == (char)0xAA);
+
+  MemoryBlock str2 = allocator->vtable->alloc(allocator, 11, DEFAULT_ALIGN);
+  bool resize1 = allocator->vtable->resize(allocator, &str1, DEFAULT_ALIGN, 1);
+  assert(resize1 == false);
+  assert(str2.ptr != NULL);
+  assert(str2.size == 16);
+  assert(str2.ptr == (char *)str1.ptr + 24); // 8-byte alignment
+  memcpy(str2.ptr, "xxxxxxxxxx\0", 11);
+  assert(strlen(str2.ptr) == 10);
+
+  bool resize2 = allocator->vtable->resize(allocator, &str2, DEFAULT_ALIGN, 5);
+  assert(resize2 == true);
+  assert(arena->current->offset == (char *)str2.ptr + str2.size);
+
+  MemoryBlock str3 = allocator->vtable->alloc(allocator, 2, DEFAULT_ALIGN);
   assert(str3.ptr != NULL);
   assert(str3.size == 8);
   assert(str3.ptr == (char *)str2.ptr + 8); // 8-byte alignment
   memcpy(str3.ptr, "z\0", 2);
   assert(strlen(str3.ptr) == 1);
 
-  // does it allocate new page
-  assert(arena->next == NULL);
-  MemoryBlock str4 = allocator->vtable->alloc(allocator, 4040);
-  assert(arena->next != NULL);
-  assert(str4.ptr != NULL);
-  assert(str4.size == 4040);
-  memcpy(str4.ptr, "bbb\0", 4);
+  // does it allocate new chunk, twice the size of the first
+  assert(arena->first->next == NULL);
+  MemoryBlock str4 = allocator->vtable->alloc(allocator, 4040, DEFAULT_ALIGN);
+  assert(arena->first->next != NULL);
+  assert(arena->current == arena->first->next);
+  assert(arena->current->size == 8192);
+  assert(str4.ptr != NULL);
+  assert(str4.size == 4040);
+  assert(str4.ptr == (char *)arena->current + chunk_header);
+  memcpy(str4.ptr, "bbb\0", 4);
+
+  // bumps the current chunk, older chunks aren't searched
+  MemoryBlock str5 = allocator->vtable->alloc(allocator, 3, DEFAULT_ALIGN);
+  assert(str5.ptr != NULL);
+  assert(str5.ptr == (char *)str4.ptr + 4040);
+  memcpy(str5.ptr, "55\0", 2);
+
+  // next chunk doubles again
+  MemoryBlock str6 = allocator->vtable->alloc(allocator, 8000, DEFAULT_ALIGN);
+  assert(arena->current->size == 16384);
+  assert(str6.ptr == (char *)arena->current + chunk_header);
+
+  // oversized allocations get a dedicated chunk, current keeps bumping
+  ArenaChunk *current = arena->current;
+  MemoryBlock str7 = allocator->vtable->alloc(allocator, 100000, DEFAULT_ALIGN);
+  assert(str7.ptr != NULL);
+  assert(str7.size == 100000);
+  assert(arena->current == current);
+  assert(current->next->size == 102400);
+  assert(str7.ptr == (char *)current->next + chunk_header);
+  memset(str7.ptr, 7, str7.size);
+  MemoryBlock str8 = allocator->vtable->alloc(allocator, 8, DEFAULT_ALIGN);
+  assert(str8.ptr == (char *)str6.ptr + 8000);
+
+  // alignment, in the current chunk and past what a page gives
+  MemoryBlock aligned1 = allocator->vtable->alloc(allocator, 16, 5);
+  assert((uintptr_t)aligned1.ptr % 32 == 0);
+  assert((char *)aligned1.ptr - ((char *)str8.ptr + 8) < 32);
+  MemoryBlock aligned2 = allocator->vtable->alloc(allocator, 100, 13);
+  assert((uintptr_t)aligned2.ptr % 8192 == 0);
+  MemoryBlock aligned3 = allocator->vtable->alloc(allocator, 50000, 14);
+  assert((uintptr_t)aligned3.ptr % 16384 == 0);
+  memset(aligned3.ptr, 3, aligned3.size);
+
+  // growth is capped
+  for (int i = 0; i < 1000; i++) {
+    allocator->vtable->alloc(allocator, 4000, DEFAULT_ALIGN);
+  }
+  assert(arena->chunk_size == ARENA_MAX_CHUNK);
+  assert(arena->current->size == ARENA_MAX_CHUNK);
+
+  // free page
+  allocator->vtable->free(allocator, (MemoryBlock){NULL, 0});
+
+  // uncomment to check whether mem has been munmap'd
+  // memset(str1.ptr, 1, 1);
+  // memset(str4.ptr, 1, 1);
+
+  printf("all arena allocator tests passed\n");
+}
+
+void test_arena_reset(Allocator *allocator) {
+  ArenaAllocator *arena = (ArenaAllocator *)allocator;
+
+  // simulate a request that grows a few chunks
+  MemoryBlock first = allocator->vtable->alloc(allocator, 100, DEFAULT_ALIGN);
+  for (int i = 0; i < 15; i++) {
+    allocator->vtable->alloc(allocator, 3000, DEFAULT_ALIGN);
+  }
+  int chunks = 0;
+  size_t mapped = 0;
+  for (ArenaChunk *chunk = arena->first; chunk; chunk = chunk->next) {
+    chunks++;
+    mapped += chunk->size;
+  }
+  assert(chunks == 4); // 4K + 8K + 16K + 32K
+  assert(mapped == 61440);
+
+  // retain capacity, same pattern reuses the same chunks, no new mappings
+  arena_reset(allocator, ARENA_RETAIN_CAPACITY, 0);
+  assert(arena->current == arena->first);
+  assert(!ZALLOC_SAFETY || ((char *)first.ptr)[0] == (char)0xAA);
+  MemoryBlock again = allocator->vtable->alloc(allocator, 100, DEFAULT_ALIGN);
+  assert(again.ptr == first.ptr);
+  for (int i = 0; i < 15; i++) {
+    allocator->vtable->alloc(allocator, 3000, DEFAULT_ALIGN);
+  }
+  int chunks_after = 0;
+  for (ArenaChunk *chunk = arena->first; chunk; chunk = chunk->next) {
+    chunks_after++;
+  }
+  assert(chunks_after == chunks);
+  assert(arena->current->next == NULL);
+
+  // retain with limit trims what doesn't fit
+  arena_reset(allocator, ARENA_RETAIN_WITH_LIMIT, 16384);
+  size_t retained = 0;
+  for (ArenaChunk *chunk = arena->first; chunk; chunk = chunk->next) {
+    retained += chunk->size;
+  }
+  assert(retained == 4096 + 8192);
+
+  // free all keeps only the chunk holding the arena
+  arena_reset(allocator, ARENA_FREE_ALL, 0);
+  assert(arena->first->next == NULL);
+  assert(arena->chunk_size == ARENA_MIN_CHUNK * 2);
+  MemoryBlock after = allocator->vtable->alloc(allocator, 8, DEFAULT_ALIGN);
+  assert(after.ptr == first.ptr);
+
+  // growing buffers, small blocks and oversized ones, the same every round:
+  // after the first round it all fits in the chunks that were kept
+  for (int round = 0; round < 8; round++) {
+    MemoryBlock buffers[3] = {0};
+    for (int i = 0; i < 3000; i++) {
+      MemoryBlock *buffer = &buffers[i % 3];
+      size_t size = buffer->ptr ? buffer->size + buffer->size / 2 : 16;
+      *buffer = buffer->ptr ? allocator->vtable->remap(allocator, *buffer,
+                                                        DEFAULT_ALIGN, size)
+                            : allocator->vtable->alloc(allocator, size,
+                                                       DEFAULT_ALIGN);
+      if (buffer->size > (1 << 20))
+        buffer->ptr = NULL;
+      allocator->vtable->alloc(allocator, 24 + i % 200, DEFAULT_ALIGN);
+      if (i % 1000 == 0)
+        allocator->vtable->alloc(allocator, 3 << 20, DEFAULT_ALIGN);
+    }
+    if (round == 0)
+      mapped = arena->mapped;
+    assert(arena->mapped == mapped);
+    arena_reset(allocator, ARENA_RETAIN_CAPACITY, 0);
+  }
+
+  allocator->vtable->free(allocator, (MemoryBlock){NULL, 0});
+  printf("all arena reset tests passed\n");
+}
+
+void test_arena_save(Allocator *allocator) {
+  ArenaAllocator *arena = (ArenaAllocator *)allocator;
+  MemoryBlock kept = allocator->vtable->alloc(allocator, 100, DEFAULT_ALIGN);
+  memset(kept.ptr, 1, kept.size);
+  MemoryBlock big = allocator->vtable->alloc(allocator, 50000, DEFAULT_ALIGN);
+  memset(big.ptr, 2, big.size);
+
+  // rolling back within the current chunk
+  ArenaSavepoint outer = arena_save(allocator);
+  MemoryBlock scratch = allocator->vtable->alloc(allocator, 64, DEFAULT_ALIGN);
+  arena_restore(allocator, outer);
+  assert(!ZALLOC_SAFETY || ((char *)scratch.ptr)[0] == (char)0xAA);
+  MemoryBlock again = allocator->vtable->alloc(allocator, 64, DEFAULT_ALIGN);
+  assert(again.ptr == scratch.ptr);
+  arena_restore(allocator, outer);
+
+  // spilling into new chunks, one of them oversized, and nesting
+  ArenaChunk *saved = arena->current;
+  MemoryBlock first = allocator->vtable->alloc(allocator, 3000, DEFAULT_ALIGN);
+  ArenaSavepoint inner = arena_save(allocator);
+  for (int i = 0; i < 20; i++) {
+    MemoryBlock block = allocator->vtable->alloc(allocator, 2000, DEFAULT_ALIGN);
+    memset(block.ptr, 3, block.size);
+  }
+  allocator->vtable->alloc(allocator, 200000, DEFAULT_ALIGN);
+  assert(arena->current != saved);
+  arena_restore(allocator, inner);
+  assert(arena->current == inner.chunk);
+  assert(arena->current->offset == inner.offset);
+  arena_restore(allocator, outer);
+  assert(arena->current == saved);
+  again = allocator->vtable->alloc(allocator, 3000, DEFAULT_ALIGN);
+  assert(again.ptr == first.ptr);
+
+  // the chunks the scope used are reused, not mapped again
+  size_t mapped = 0, mapped_after = 0;
+  for (ArenaChunk *c = arena->first; c != NULL; c = c->next) {
+    mapped += c->size;
+  }
+  for (int i = 0; i < 20; i++) {
+    allocator->vtable->alloc(allocator, 2000, DEFAULT_ALIGN);
+  }
+  for (ArenaChunk *c = arena->first; c != NULL; c = c->next) {
+    mapped_after += c->size;
+  }
+  assert(mapped_after == mapped);
+
+  // what came before the savepoint is untouched
+  for (size_t i = 0; i < kept.size; i++) {
+    assert(((char *)kept.ptr)[i] == 1);
+  }
+  for (size_t i = 0; i < big.size; i++) {
+    assert(((char *)big.ptr)[i] == 2);
+  }
+#if ZALLOC_STATS
+  arena_restore(allocator, outer);
+  assert(arena->counters.live_bytes == 104 + 50000);
+#endif
+
+  allocator->vtable->free(allocator, (MemoryBlock){NULL, 0});
+  printf("all arena savepoint tests passed\n");
+}
+
+void test_zalloc(void) {
+  // the typed fast path and the vtable bump the same offset
+  char buffer[256];
+  Allocator *allocator = create_fixed_buffer_allocator(buffer, sizeof(buffer));
+  FixedBufferAllocator *fba = (FixedBufferAllocator *)allocator;
+  MemoryBlock str1 = zalloc(fba, 12, DEFAULT_ALIGN);
+  MemoryBlock str2 = zalloc(allocator, 12, DEFAULT_ALIGN);
+  assert(str1.size == 16 && str2.size == 16);
+  assert(str2.ptr == (char *)str1.ptr + 16);
+  MemoryBlock aligned = zalloc(fba, 8, 5);
+  assert((uintptr_t)aligned.ptr % 32 == 0);
+
+  allocator = create_arena_allocator();
+  ArenaAllocator *arena = (ArenaAllocator *)allocator;
+  MemoryBlock a = zalloc(arena, 20, DEFAULT_ALIGN);
+  MemoryBlock b = zalloc(allocator, 20, DEFAULT_ALIGN);
+  assert(a.size == 24 && b.ptr == (char *)a.ptr + 24);
+
+  // a miss on the current chunk still gets a new one
+  ArenaChunk *first = arena->current;
+  MemoryBlock big = zalloc(arena, 5000, DEFAULT_ALIGN);
+  assert(big.size == 5000 && arena->current != first);
+  memset(big.ptr, 1, big.size);
+#if ZALLOC_STATS
+  assert(arena->counters.allocs == 3);
+#endif
+  allocator->vtable->free(allocator, (MemoryBlock){NULL, 0});
+  printf("all typed entry point tests passed\n");
+}
+
+// memory pool: same-size items like zig's std.heap.MemoryPool. new items are
+// bumped out of an arena, freed ones go onto a free list that alloc pops
+// first, so steady state is one push or pop per call
+typedef struct MemoryPoolItem {
+  struct MemoryPoolItem *next;
+} MemoryPoolItem;
+
+typedef struct {
+  Allocator base;
+  Allocator *arena; // the pool itself is its first allocation
+  MemoryPoolItem *free_list;
+  size_t item_size;
+  uint8_t log2_align;
+#if ZALLOC_STATS
+  AllocatorCounters counters;
+#endif
+} MemoryPool;
+
+static MemoryBlock memory_pool_alloc(Allocator *self, size_t size,
+                                     uint8_t log2_align) {
+  MemoryPool *pool = (MemoryPool *)self;
+  if (size > pool->item_size || log2_align > pool->log2_align) {
+    perror("pool item too big");
+    exit(1);
+  }
+
+  void *ptr = pool->free_list;
+  if (ptr != NULL) {
+    pool->free_list = pool->free_list->next;
+    poison(ptr, sizeof(MemoryPoolItem));
+  } else {
+    ptr = arena_alloc(pool->arena, pool->item_size, pool->log2_align).ptr;
+    if (ptr == NULL)
+      return (MemoryBlock){NULL, 0};
+  }
+  STAT(counters_alloc(&pool->counters, size, pool->item_size));
+  return (MemoryBlock){ptr, pool->item_size};
+}
+
+static void memory_pool_free(Allocator *self, MemoryBlock memory) {
+  MemoryPool *pool = (MemoryPool *)self;
+  poison(memory.ptr, pool->item_size);
+  MemoryPoolItem *item = memory.ptr;
+  item->next = pool->free_list;
+  pool->free_list = item;
+  STAT(counters_free(&pool->counters, pool->item_size));
+}
+
+static bool memory_pool_resize(Allocator *self, MemoryBlock *memory,
+                               uint8_t log2_align, size_t new_size) {
+  MemoryPool *pool = (MemoryPool *)self;
+  if (new_size > pool->item_size || log2_align > pool->log2_align)
+    return false;
+  memory->size = new_size;
+  return true;
+}
+
+// an item can't outgrow the pool, there is nowhere to move it
+static MemoryBlock memory_pool_remap(Allocator *self, MemoryBlock memory,
+                                     uint8_t log2_align, size_t new_size) {
+  if (!memory_pool_resize(self, &memory, log2_align, new_size)) {
+    perror("pool item too big");
+    exit(1);
+  }
+  return memory;
+}
+
+// the free list first, whatever is left in one arena bump
+static size_t memory_pool_alloc_many(Allocator *self, size_t size,
+                                     uint8_t log2_align, void **out,
+                                     size_t count) {
+  MemoryPool *pool = (MemoryPool *)self;
+  if (size > pool->item_size || log2_align > pool->log2_align) {
+    perror("pool item too big");
+    exit(1);
+  }
+
+  size_t i = 0;
+  for (; i < count && pool->free_list != NULL; i++) {
+    out[i] = pool->free_list;
+    pool->free_list = pool->free_list->next;
+    poison(out[i], sizeof(MemoryPoolItem));
+  }
+  if (i < count && arena_alloc_many(pool->arena, pool->item_size,
+                                    pool->log2_align, out + i,
+                                    count - i) == 0) {
+    // the items taken so far go back in the order they came
+    while (i > 0) {
+      MemoryPoolItem *item = out[--i];
+      item->next = pool->free_list;
+      pool->free_list = item;
+    }
+    return 0;
+  }
+  STAT(counters_alloc(&pool->counters, size * count, pool->item_size * count));
+  STAT(pool->counters.allocs += count - 1);
+  return pool->item_size;
+}
+
+// the items are chained up first and spliced onto the free list at once
+static void memory_pool_free_many(Allocator *self, size_t size, void **ptrs,
+                                  size_t count) {
+  (void)size;
+  MemoryPool *pool = (MemoryPool *)self;
+  if (count == 0)
+    return;
+  for (size_t i = 0; i < count; i++) {
+    poison(ptrs[i], pool->item_size);
+    ((MemoryPoolItem *)ptrs[i])->next =
+        i + 1 < count ? ptrs[i + 1] : pool->free_list;
+  }
+  pool->free_list = ptrs[0];
+  STAT(pool->counters.live_bytes -= pool->item_size * count);
+  STAT(pool->counters.frees += count);
+}
+
+static void memory_pool_stats(Allocator *self, AllocatorStats *out) {
+  MemoryPool *pool = (MemoryPool *)self;
+  arena_stats(pool->arena, out);
+  STAT(out->counters = pool->counters);
+}
+
+AllocatorVTable memory_pool_vtable = {.alloc = memory_pool_alloc,
+                                      .free = memory_pool_free,
+                                      .resize = memory_pool_resize,
+                                      .remap = memory_pool_remap,
+                                      .stats = memory_pool_stats,
+                                      .alloc_many = memory_pool_alloc_many,
+                                      .free_many = memory_pool_free_many,
+                                      .alloc_zeroed = generic_alloc_zeroed};
+
+// items are rounded up to hold the free list link and to keep the next one
+// aligned, so the arena packs them without padding
+Allocator *create_memory_pool(size_t item_size, uint8_t log2_align) {
+  if (log2_align < DEFAULT_ALIGN)
+    log2_align = DEFAULT_ALIGN;
+  size_t alignment = (size_t)1 << log2_align;
+  if (item_size < sizeof(MemoryPoolItem))
+    item_size = sizeof(MemoryPoolItem);
+  item_size = (item_size + alignment - 1) & ~(alignment - 1);
+
+  Allocator *arena = create_arena_allocator();
+  if (arena == NULL)
+    return NULL;
+  MemoryPool *pool =
+      arena_alloc(arena, sizeof(MemoryPool), DEFAULT_ALIGN).ptr;
+  pool->base.vtable = &memory_pool_vtable;
+  pool->arena = arena;
+  pool->free_list = NULL;
+  pool->item_size = item_size;
+  pool->log2_align = log2_align;
+  STAT(memset(&pool->counters, 0, sizeof(pool->counters)));
+  return (Allocator *)pool;
+}
+
+// forgets every item, the chunks are kept or unmapped as arena_reset does.
+// the pool lives in the arena's first allocation, it gets bumped back into
+// the same spot right after the reset
+void memory_pool_reset(Allocator *allocator, ArenaResetMode mode,
+                       size_t limit) {
+  MemoryPool saved = *(MemoryPool *)allocator;
+  arena_reset(saved.arena, mode, limit);
+  MemoryPool *pool =
+      arena_alloc(saved.arena, sizeof(MemoryPool), DEFAULT_ALIGN).ptr;
+  assert(pool == (MemoryPool *)allocator);
+  *pool = saved;
+  pool->free_list = NULL;
+  STAT(pool->counters.live_bytes = 0);
+}
+
+void memory_pool_deinit(Allocator *allocator) {
+  Allocator *arena = ((MemoryPool *)allocator)->arena;
+  arena->vtable->free(arena, (MemoryBlock){NULL, 0});
+}
+
+void test_memory_pool(void) {
+  Allocator *pool = create_memory_pool(40, 4);
+  assert(((MemoryPool *)pool)->item_size == 48); // rounded to the alignment
+
+  MemoryBlock a = pool->vtable->alloc(pool, 40, 4);
+  MemoryBlock b = pool->vtable->alloc(pool, 1, DEFAULT_ALIGN);
+  MemoryBlock c = pool->vtable->alloc(pool, 48, 4);
+  assert(a.size == 48 && b.size == 48);
+  assert((uintptr_t)a.ptr % 16 == 0);
+  assert(b.ptr == (char *)a.ptr + 48); // packed, no padding between items
+  assert(c.ptr == (char *)b.ptr + 48);
+
+  // freed items come back last in, first out
+  pool->vtable->free(pool, b);
+  pool->vtable->free(pool, a);
+  assert(pool->vtable->alloc(pool, 40, 4).ptr == a.ptr);
+  MemoryBlock reused = pool->vtable->alloc(pool, 40, 4);
+  assert(reused.ptr == b.ptr);
+  assert(!ZALLOC_SAFETY || ((char *)reused.ptr)[0] == (char)0xAA);
+
+  // resizing stays within the item
+  assert(pool->vtable->resize(pool, &reused, 4, 48));
+  assert(!pool->vtable->resize(pool, &reused, 4, 49));
+  assert(!pool->vtable->resize(pool, &reused, 5, 16));
+
+  // thousands of items spill over into new chunks
+  for (int i = 0; i < 10000; i++) {
+    MemoryBlock item = pool->vtable->alloc(pool, 48, 4);
+    memset(item.ptr, 1, item.size);
+  }
+
+  // after a reset items start over at the beginning of the first chunk
+  memory_pool_reset(pool, ARENA_RETAIN_CAPACITY, 0);
+  assert(((MemoryPool *)pool)->free_list == NULL);
+  assert(pool->vtable->alloc(pool, 40, 4).ptr == a.ptr);
+  memory_pool_deinit(pool);
+
+  printf("all memory pool tests passed\n");
+}
+
+typedef struct GPABucket GPABucket;
+typedef struct GeneralPurposeAllocator GeneralPurposeAllocator;
+
+// every bucket is a slab of one or a few 4096-byte pages of same-size slots.
+// the slab itself is all slots, its descriptor lives out-of-band in the
+// segment header, on the slab's first page
+struct GPABucket {
+  void *offset;
+  uint32_t bucket_size;
+  uint32_t live; // slots handed out and not freed yet
+  GPABucket *prev; // next page in the class that still has room
+  GPABucket *next;
+  struct GPAFreeSlot *free_list;
+  // slots freed from other threads, drained by whoever owns the page
+  _Atomic(struct GPAFreeSlot *) remote_free;
+  GPABucket *pending_next;
+  uint32_t empty_epoch; // the decay tick live last went to 0 in
+  uint16_t slab_pages;  // set on the slab's first page
+  uint16_t slab_page;   // how far this page is from the slab's first page
+};
+
+// bucket pages are carved from a gpa's own segments, the first pages of a
+// segment hold the descriptors of all of them. so the descriptor of any small
+// allocation is a mask and a shift away
+typedef struct GPASegment {
+  struct GPASegment *prev; // segments with an unused page
+  struct GPASegment *next;
+  struct GPASegment *all_prev; // every segment of the gpa
+  struct GPASegment *all_next;
+  size_t free_count;
+  uint64_t free_pages[SEGMENT_PAGES / 64]; // bit i set means page i is unused
+  GPABucket pages[SEGMENT_PAGES]; // the header's own pages are never used
+} GPASegment;
+
+#define GPA_SEGMENT_HEADER_PAGES ((sizeof(GPASegment) + 4095) >> 12)
+
+// freed slots are threaded into their page's free list, the link lives in
+// the first word of the slot so the smallest class must fit a pointer
+typedef struct GPAFreeSlot {
+  struct GPAFreeSlot *next;
+} GPAFreeSlot;
+
+// size classes are 8 bytes apart up to 32 and four per doubling after that,
+// so past 32 bytes a block wastes under a fifth of its slot instead of up to
+// half. every class is a multiple of sizeof(GPAFreeSlot)
+#define GPA_CLASSES 28
+#define GPA_MAX_SMALL 2048 // anything bigger is large, a mapping of its own
+
+static const uint16_t gpa_class_sizes[GPA_CLASSES] = {
+    8,   16,  24,  32,  40,  48,  56,  64,   80,   96,   112,  128,  160,  192,
+    224, 256, 320, 384, 448, 512, 640, 768, 896, 1024, 1280, 1536, 1792, 2048};
+
+// pages per slab, the fewest that leave under 1/64 of the slab unused. on a
+// single page a 1536 byte class would waste a quarter of it and cost as much
+// per slot as 2048
+static const uint8_t gpa_slab_pages[GPA_CLASSES] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 1, 2, 3,
+    4, 1, 3, 3, 7, 1, 3, 3, 7, 1, 5, 3, 7, 1};
+
+// freed large mappings are kept around binned by page count, bin i holds
+// mappings of 2^i up to 2^(i+1) - 1 pages
+#define GPA_LARGE_BINS 16
+#define GPA_LARGE_BIN_SLOTS 4
+
+// packed to 16 bytes, the gpa has to fit one of its own slots
+typedef struct {
+  void *ptr;           // NULL when the slot is empty
+  uint32_t pages : 31; // mappings past GPA_LARGE_PAGES_MAX aren't cached
+  uint32_t dirty : 1;  // not madvise'd yet, still counts towards rss
+  uint32_t age;        // order of frees, compared with wraparound
+} GPALargeEntry;
+
+#define GPA_LARGE_PAGES_MAX (((size_t)1 << 31) - 1)
+
+static inline size_t gpa_large_mapped(GPALargeEntry *entry) {
+  return (size_t)entry->pages << 12;
+}
+
+// buckets[i] only links pages of class i with a free slot left, full pages are
+// unlinked until one of their slots is freed. small enough to live in one of
+// its own 2048-byte slots or inside a caller's struct
+struct GeneralPurposeAllocator {
+  Allocator base;
+  GPABucket *buckets[GPA_CLASSES];
+  GPASegment *segments;
+  GPASegment *all_segments; // full ones too, for tearing the gpa down
+  PageAllocator *pages; // segments come from here, large blocks don't
+  GPALargeEntry large_cache[GPA_LARGE_BINS][GPA_LARGE_BIN_SLOTS];
+  size_t large_cached;      // bytes held by the cache
+  size_t large_dirty;       // bytes held by the cache and not madvise'd
+  size_t large_cache_limit; // oldest mappings get munmap'd beyond this
+  size_t large_dirty_limit; // oldest mappings get madvise'd beyond this
+  uint32_t large_age;
+  // 4K pages of small slots and large blocks, not the cache. in pages so the
+  // thread-safe gpa still fits a slot, the limit tops out at 16 TiB
+  uint32_t used_pages;
+  uint32_t page_limit; // alloc fails rather than go past this
+  uint32_t decay_ms;    // empty pages wait this long to be purged, 0 doesn't
+  uint32_t decay_epoch; // one tick every decay_ms
+  uint64_t decay_next;  // when the next tick is due, coarse monotonic ms
+#if ZALLOC_STATS
+  AllocatorCounters counters; // small blocks count as their whole slot
+  uint32_t class_pages[GPA_CLASSES];
+#endif
+};
+
+_Static_assert(sizeof(GeneralPurposeAllocator) <= GPA_MAX_SMALL,
+               "the gpa must fit one of its own slots");
+_Static_assert(GPA_CLASSES <= STATS_MAX_CLASSES, "stats can't hold classes");
+
+// x must not be 0. one bit scan (bsr/lzcnt) wherever the compiler has a
+// builtin for it, five shifts otherwise
+static inline int log2_floor(size_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+  return 63 - __builtin_clzll((unsigned long long)x);
+#else
+  uint64_t value = x;
+  int result = 0;
+  for (int shift = 32; shift > 0; shift >>= 1) {
+    if (value >> shift) {
+      value >>= shift;
+      result += shift;
+    }
+  }
+  return result;
+#endif
+}
+
+static inline int log2_ceil(size_t x) {
+  return x <= 1 ? 0 : log2_floor(x - 1) + 1;
+}
+
+// no table walk: up to 32 bytes it's a shift, past that the top bit of
+// size - 1 picks the doubling and the two bits under it the quarter
+static inline int gpa_size_class(size_t size) {
+  size_t last = size - 1;
+  int top = log2_floor(last | 31);
+  int quarter_class = 4 * top - 20 + (int)(last >> (top - 2));
+  return size <= 32 ? (int)(last >> 3) : quarter_class;
+}
+
+static inline GPASegment *gpa_segment_of(void *ptr) {
+  return segment_of(ptr);
+}
+
+static inline GPABucket *gpa_bucket_of(void *ptr) {
+  GPASegment *segment = gpa_segment_of(ptr);
+  GPABucket *page =
+      &segment->pages[((uintptr_t)ptr - (uintptr_t)segment) >> 12];
+  return page - page->slab_page;
+}
+
+// the slab's first page
+static inline char *gpa_bucket_page(GPABucket *bucket) {
+  GPASegment *segment = gpa_segment_of(bucket);
+  return (char *)segment + ((bucket - segment->pages) << 12);
+}
+
+static inline char *gpa_bucket_end(GPABucket *bucket) {
+  return gpa_bucket_page(bucket) + ((size_t)bucket->slab_pages << 12);
+}
+
+static inline bool gpa_bucket_full(GPABucket *bucket) {
+  return bucket->free_list == NULL &&
+         (char *)bucket->offset + bucket->bucket_size > gpa_bucket_end(bucket);
+}
+
+static void gpa_segment_link(GeneralPurposeAllocator *gpa,
+                             GPASegment *segment) {
+  segment->prev = NULL;
+  segment->next = gpa->segments;
+  if (segment->next != NULL)
+    segment->next->prev = segment;
+  gpa->segments = segment;
+}
+
+static void gpa_segment_unlink(GeneralPurposeAllocator *gpa,
+                               GPASegment *segment) {
+  if (segment->prev != NULL)
+    segment->prev->next = segment->next;
+  else
+    gpa->segments = segment->next;
+  if (segment->next != NULL)
+    segment->next->prev = segment->prev;
+}
+
+// more is a whole number of pages in bytes
+static inline bool gpa_over_limit(GeneralPurposeAllocator *gpa, size_t more) {
+  return gpa->used_pages > gpa->page_limit ||
+         (more >> 12) > gpa->page_limit - gpa->used_pages;
+}
+
+static void gpa_decay_tick(GeneralPurposeAllocator *gpa);
+
+// first fit for a run of unused pages, SEGMENT_PAGES if there is none. a
+// single page is one bit scan, whole words of used pages are skipped
+static size_t gpa_run_find(GPASegment *segment, size_t pages) {
+  if (pages == 1) {
+    size_t word = 0;
+    while (segment->free_pages[word] == 0)
+      word++;
+    return word * 64 + __builtin_ctzll(segment->free_pages[word]);
+  }
+  size_t run = 0;
+  for (size_t i = 0; i < SEGMENT_PAGES; i++) {
+    if ((i & 63) == 0 && segment->free_pages[i >> 6] == 0) {
+      i += 63;
+      run = 0;
+    } else if (!page_bit(segment->free_pages, i)) {
+      run = 0;
+    } else if (++run == pages) {
+      return i + 1 - pages;
+    }
+  }
+  return SEGMENT_PAGES;
+}
+
+// a slab of pages in one segment. NULL past the memory limit or when no
+// segment can be mapped
+static GPABucket *gpa_page_alloc(GeneralPurposeAllocator *gpa, size_t pages) {
+  gpa_decay_tick(gpa); // pages that ran out their decay go first
+  if (gpa_over_limit(gpa, pages << 12))
+    return NULL;
+  GPASegment *segment = gpa->segments;
+  size_t idx = SEGMENT_PAGES;
+  while (segment != NULL &&
+         (segment->free_count < pages ||
+          (idx = gpa_run_find(segment, pages)) == SEGMENT_PAGES))
+    segment = segment->next;
+  if (segment == NULL) {
+    segment = gpa->pages->vtable->map(gpa->pages, SEGMENT_SIZE, SEGMENT_LOG2);
+    if (segment == NULL)
+      return NULL;
+    segment->free_count = SEGMENT_PAGES - GPA_SEGMENT_HEADER_PAGES;
+    memset(segment->free_pages, 0xFF, sizeof(segment->free_pages));
+    page_bits_set(segment->free_pages, 0, GPA_SEGMENT_HEADER_PAGES, false);
+    gpa_segment_link(gpa, segment);
+    segment->all_prev = NULL;
+    segment->all_next = gpa->all_segments;
+    if (segment->all_next != NULL)
+      segment->all_next->all_prev = segment;
+    gpa->all_segments = segment;
+    idx = GPA_SEGMENT_HEADER_PAGES;
+  }
+
+  page_bits_set(segment->free_pages, idx, pages, false);
+  segment->free_count -= pages;
+  if (segment->free_count == 0)
+    gpa_segment_unlink(gpa, segment);
+  gpa->used_pages += pages;
+  GPABucket *bucket = &segment->pages[idx];
+  for (size_t i = 0; i < pages; i++)
+    bucket[i].slab_page = i;
+  bucket->slab_pages = pages;
+  return bucket;
+}
+
+// the slab goes back to its segment and its memory back to the kernel, a
+// segment with nothing left in it is unmapped unless it is the last one
+static void gpa_page_free(GeneralPurposeAllocator *gpa, GPABucket *bucket) {
+  GPASegment *segment = gpa_segment_of(bucket);
+  size_t pages = bucket->slab_pages;
+  STAT_SYSCALL(madvises);
+  madvise(gpa_bucket_page(bucket), pages << 12, MADV_DONTNEED);
+  gpa->used_pages -= pages;
+
+  if (segment->free_count == 0)
+    gpa_segment_link(gpa, segment);
+  segment->free_count += pages;
+  page_bits_set(segment->free_pages, bucket - segment->pages, pages, true);
+
+  bool last_segment = gpa->segments == segment && segment->next == NULL;
+  if (segment->free_count == SEGMENT_PAGES - GPA_SEGMENT_HEADER_PAGES &&
+      !last_segment) {
+    gpa_segment_unlink(gpa, segment);
+    if (segment->all_prev != NULL)
+      segment->all_prev->all_next = segment->all_next;
+    else
+      gpa->all_segments = segment->all_next;
+    if (segment->all_next != NULL)
+      segment->all_next->all_prev = segment->all_prev;
+    gpa->pages->vtable->unmap(gpa->pages, segment, SEGMENT_SIZE, SEGMENT_LOG2);
+  }
+}
+
+static void gpa_bucket_link(GeneralPurposeAllocator *gpa, int idx,
+                            GPABucket *bucket) {
+  bucket->next = NULL;
+  bucket->prev = gpa->buckets[idx];
+  if (bucket->prev != NULL)
+    bucket->prev->next = bucket;
+  gpa->buckets[idx] = bucket;
+}
+
+static void gpa_bucket_unlink(GeneralPurposeAllocator *gpa, int idx,
+                              GPABucket *bucket) {
+  if (bucket->next != NULL)
+    bucket->next->prev = bucket->prev;
+  else
+    gpa->buckets[idx] = bucket->prev;
+  if (bucket->prev != NULL)
+    bucket->prev->next = bucket->next;
+  bucket->prev = NULL;
+  bucket->next = NULL;
+}
+
+// empty pages stay in their class for a while, so load that comes and goes
+// in waves reuses them instead of paying a madvise and the faults after it
+// every time. like jemalloc's dirty decay, but without a background thread:
+// time only moves on the cold paths, when a page goes empty or a new one is
+// needed, and in gpa_decay for allocators that went idle
+#define GPA_DECAY_MS 10000
+
+static inline uint64_t gpa_clock_ms(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+  return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// every empty page that has been for min_age ticks, except a class's last
+static void gpa_decay_sweep(GeneralPurposeAllocator *gpa, uint32_t min_age) {
+  for (int idx = 0; idx < GPA_CLASSES; idx++) {
+    GPABucket *bucket = gpa->buckets[idx];
+    while (bucket != NULL) {
+      GPABucket *older = bucket->prev;
+      bool last_page = gpa->buckets[idx] == bucket && bucket->prev == NULL;
+      if (bucket->live == 0 && !last_page &&
+          gpa->decay_epoch - bucket->empty_epoch >= min_age) {
+        gpa_bucket_unlink(gpa, idx, bucket);
+        STAT(gpa->class_pages[idx] -= bucket->slab_pages);
+        gpa_page_free(gpa, bucket);
+      }
+      bucket = older;
+    }
+  }
+}
+
+// a page is purged on the second tick after it went empty, so it waited
+// between decay_ms and twice that. a tick after a long idle stretch counts
+// every period it missed
+static void gpa_decay_tick(GeneralPurposeAllocator *gpa) {
+  if (gpa->decay_ms == 0)
+    return;
+  uint64_t now = gpa_clock_ms();
+  if (now < gpa->decay_next)
+    return;
+  gpa->decay_epoch += 1 + (now - gpa->decay_next) / gpa->decay_ms;
+  gpa->decay_next = now + gpa->decay_ms;
+  gpa_decay_sweep(gpa, 2);
+}
+
+// slots start at multiples of their size from the page, so a class is aligned
+// to its lowest set bit. over-aligned requests move up to the first class
+// that is. GPA_CLASSES means large
+static inline int gpa_aligned_class(size_t size, uint8_t log2_align) {
+  if (size > GPA_MAX_SMALL || log2_align > 11)
+    return GPA_CLASSES;
+  int cls = gpa_size_class(size);
+  while (__builtin_ctz(gpa_class_sizes[cls]) < log2_align)
+    cls++;
+  return cls;
+}
+
+static inline int gpa_large_bin(size_t mapped) {
+  int bin = log2_floor(mapped >> 12);
+  return bin < GPA_LARGE_BINS ? bin : GPA_LARGE_BINS - 1;
+}
+
+static void gpa_large_evict(GeneralPurposeAllocator *gpa,
+                            GPALargeEntry *entry) {
+  STAT_SYSCALL(munmaps);
+  munmap(entry->ptr, gpa_large_mapped(entry));
+  gpa->large_cached -= gpa_large_mapped(entry);
+  if (entry->dirty)
+    gpa->large_dirty -= gpa_large_mapped(entry);
+  entry->ptr = NULL;
+}
+
+// lets the kernel take the pages back under pressure, the mapping stays
+static void gpa_large_purge(GeneralPurposeAllocator *gpa,
+                            GPALargeEntry *entry) {
+  STAT_SYSCALL(madvises);
+#ifdef MADV_FREE
+  if (madvise(entry->ptr, gpa_large_mapped(entry), MADV_FREE) != 0)
+#endif
+    madvise(entry->ptr, gpa_large_mapped(entry), MADV_DONTNEED);
+  gpa->large_dirty -= gpa_large_mapped(entry);
+  entry->dirty = false;
+}
+
+static GPALargeEntry *gpa_large_oldest(GeneralPurposeAllocator *gpa,
+                                       bool dirty_only) {
+  GPALargeEntry *oldest = NULL;
+  for (int bin = 0; bin < GPA_LARGE_BINS; bin++) {
+    for (int i = 0; i < GPA_LARGE_BIN_SLOTS; i++) {
+      GPALargeEntry *entry = &gpa->large_cache[bin][i];
+      if (entry->ptr == NULL || (dirty_only && !entry->dirty))
+        continue;
+      if (oldest == NULL || (int32_t)(entry->age - oldest->age) < 0)
+        oldest = entry;
+    }
+  }
+  return oldest;
+}
+
+// zeroed leaves a fresh mapping as the kernel zeroed it and clears a cached
+// one, MADV_FREE may have left its old contents
+static void *gpa_large_alloc(GeneralPurposeAllocator *gpa, size_t size,
+                             uint8_t log2_align, bool zeroed) {
+  size_t mapped = (size + 4095) & ~(size_t)4095;
+  size_t align_mask = ((size_t)1 << log2_align) - 1;
+  if (gpa_over_limit(gpa, mapped))
+    return NULL;
+
+  // smallest cached mapping that fits, from this bin or the next one up
+  GPALargeEntry *best = NULL;
+  int bin = gpa_large_bin(mapped);
+  for (int b = bin; b <= bin + 1 && b < GPA_LARGE_BINS; b++) {
+    for (int i = 0; i < GPA_LARGE_BIN_SLOTS; i++) {
+      GPALargeEntry *entry = &gpa->large_cache[b][i];
+      if (entry->ptr == NULL || gpa_large_mapped(entry) < mapped ||
+          ((uintptr_t)entry->ptr & align_mask) != 0)
+        continue;
+      if (best == NULL || entry->pages < best->pages)
+        best = entry;
+    }
+  }
+  if (best == NULL) {
+    void *page = zeroed ? map_pages(size, log2_align)
+                        : new_aligned_page_memory(size, log2_align);
+    if (page != NULL)
+      gpa->used_pages += mapped >> 12;
+    return page;
+  }
+
+  void *ptr = best->ptr;
+  gpa->used_pages += mapped >> 12;
+  size_t cached = gpa_large_mapped(best);
+  gpa->large_cached -= cached;
+  if (best->dirty)
+    gpa->large_dirty -= cached;
+  // free only knows the block size, hand back exactly that many pages
+  if (cached > mapped) {
+    STAT_SYSCALL(munmaps);
+    munmap((char *)ptr + mapped, cached - mapped);
+  }
+  best->ptr = NULL;
+
+  if (zeroed)
+    fill_memory(ptr, 0, size);
+  else
+    poison(ptr, size);
+  return ptr;
+}
+
+static void gpa_large_free(GeneralPurposeAllocator *gpa, MemoryBlock memory) {
+  size_t mapped = (memory.size + 4095) & ~(size_t)4095;
+  gpa->used_pages -= mapped >> 12;
+  if (mapped > gpa->large_cache_limit || mapped >> 12 > GPA_LARGE_PAGES_MAX) {
+    STAT_SYSCALL(munmaps);
+    munmap(memory.ptr, mapped);
+    return;
+  }
+
+  // take an empty slot in the bin, or the oldest one
+  int bin = gpa_large_bin(mapped);
+  GPALargeEntry *slot = NULL;
+  for (int i = 0; i < GPA_LARGE_BIN_SLOTS; i++) {
+    GPALargeEntry *entry = &gpa->large_cache[bin][i];
+    if (entry->ptr == NULL) {
+      slot = entry;
+      break;
+    }
+    if (slot == NULL || (int32_t)(entry->age - slot->age) < 0)
+      slot = entry;
+  }
+  if (slot->ptr != NULL)
+    gpa_large_evict(gpa, slot);
+
+  *slot = (GPALargeEntry){memory.ptr, mapped >> 12, true, gpa->large_age++};
+  gpa->large_cached += mapped;
+  gpa->large_dirty += mapped;
+
+  // madvise is only paid once the dirty budget runs out
+  while (gpa->large_cached > gpa->large_cache_limit)
+    gpa_large_evict(gpa, gpa_large_oldest(gpa, false));
+  while (gpa->large_dirty > gpa->large_dirty_limit)
+    gpa_large_purge(gpa, gpa_large_oldest(gpa, true));
+}
+
+// the page at the head of the class, a fresh one if the class has no room
+static GPABucket *gpa_class_page(GeneralPurposeAllocator *gpa,
+                                 int bucket_index) {
+  GPABucket *bucket = gpa->buckets[bucket_index];
+  if (bucket == NULL) {
+    bucket = gpa_page_alloc(gpa, gpa_slab_pages[bucket_index]);
+    if (bucket == NULL)
+      return NULL;
+    bucket->bucket_size = gpa_class_sizes[bucket_index];
+    // the slab starts with a slot, every slot is aligned to its size
+    bucket->offset = gpa_bucket_page(bucket);
+    poison(bucket->offset, gpa_bucket_end(bucket) - (char *)bucket->offset);
+    bucket->free_list = NULL;
+    bucket->live = 0;
+    bucket->empty_epoch = gpa->decay_epoch;
+    atomic_init(&bucket->remote_free, NULL);
+    gpa_bucket_link(gpa, bucket_index, bucket);
+    STAT(gpa->class_pages[bucket_index] += bucket->slab_pages);
+  }
+  return bucket;
+}
+
+// zeroed clears a reused slot. bumped ones are untouched since the page was
+// mapped or madvise'd, unless it was poisoned or its pages don't come zeroed
+static MemoryBlock gpa_small_alloc(GeneralPurposeAllocator *gpa,
+                                   int bucket_index, bool zeroed) {
+  size_t bucket_size = gpa_class_sizes[bucket_index];
+  GPABucket *bucket = gpa_class_page(gpa, bucket_index);
+  if (bucket == NULL)
+    return (MemoryBlock){NULL, 0};
+
+  // reuse a freed slot before bumping
+  void *ptr;
+  if (bucket->free_list != NULL) {
+    ptr = bucket->free_list;
+    bucket->free_list = bucket->free_list->next;
+    if (zeroed)
+      memset(ptr, 0, bucket_size);
+    else
+      poison(ptr, sizeof(GPAFreeSlot));
+  } else {
+    ptr = bucket->offset;
+    bucket->offset = (char *)bucket->offset + bucket_size;
+    if (zeroed && (ZALLOC_SAFETY || !gpa->pages->zeroed))
+      memset(ptr, 0, bucket_size);
+  }
+  bucket->live++;
+
+  if (gpa_bucket_full(bucket))
+    gpa_bucket_unlink(gpa, bucket_index, bucket);
+  return (MemoryBlock){ptr, bucket_size};
+}
+
+// a slab at a time: its whole free list, then as many slots as are left to
+// bump in one go. those come out contiguous and in address order. returns how
+// many there were room for
+static size_t gpa_small_alloc_many(GeneralPurposeAllocator *gpa,
+                                   int bucket_index, void **out,
+                                   size_t count) {
+  size_t bucket_size = gpa_class_sizes[bucket_index];
+  size_t done = 0;
+  while (done < count) {
+    GPABucket *bucket = gpa_class_page(gpa, bucket_index);
+    if (bucket == NULL)
+      break;
+    size_t first = done;
+    while (done < count && bucket->free_list != NULL) {
+      out[done] = bucket->free_list;
+      bucket->free_list = bucket->free_list->next;
+      poison(out[done++], sizeof(GPAFreeSlot));
+    }
+
+    size_t room = (gpa_bucket_end(bucket) - (char *)bucket->offset) /
+                  bucket_size;
+    size_t bump = count - done < room ? count - done : room;
+    for (size_t i = 0; i < bump; i++) {
+      out[done++] = (char *)bucket->offset + i * bucket_size;
+    }
+    bucket->offset = (char *)bucket->offset + bump * bucket_size;
+    bucket->live += done - first;
+
+    if (gpa_bucket_full(bucket))
+      gpa_bucket_unlink(gpa, bucket_index, bucket);
+  }
+  return done;
+}
+
+static inline MemoryBlock gpa_alloc_block(GeneralPurposeAllocator *gpa,
+                                          size_t size, uint8_t log2_align,
+                                          bool zeroed) {
+  if (size <= 0) {
+    perror("invalid allocation size");
+    exit(1);
+  }
+  if (size > ALLOC_SIZE_MAX || log2_align >= 62)
+    return (MemoryBlock){NULL, 0};
+
+  int bucket_index = gpa_aligned_class(size, log2_align);
+  if (bucket_index == GPA_CLASSES) {
+    // mmap aligns to the page, the block is at least as big as its alignment
+    // so free and resize can tell it is large from the size alone
+    size_t alignment = (size_t)1 << log2_align;
+    size = size < alignment ? alignment : size;
+    void *page = gpa_large_alloc(gpa, size, log2_align, zeroed);
+    if (page == NULL)
+      return (MemoryBlock){NULL, 0};
+    STAT(counters_alloc(&gpa->counters, size, size));
+    return (MemoryBlock){page, size};
+  }
+  MemoryBlock block = gpa_small_alloc(gpa, bucket_index, zeroed);
+  if (block.ptr != NULL)
+    STAT(counters_alloc(&gpa->counters, size, block.size));
+  return block;
+}
+
+static MemoryBlock gpa_alloc(Allocator *self, size_t size,
+                             uint8_t log2_align) {
+  return gpa_alloc_block((GeneralPurposeAllocator *)self, size, log2_align,
+                         false);
+}
+
+static MemoryBlock gpa_alloc_zeroed(Allocator *self, size_t size,
+                                    uint8_t log2_align) {
+  return gpa_alloc_block((GeneralPurposeAllocator *)self, size, log2_align,
+                         true);
+}
+
+// the slot back onto its page, uncounted
+static void gpa_small_free(GeneralPurposeAllocator *gpa, void *ptr) {
+  // the page knows the real slot size, memory.size may have been resized
+  GPABucket *bucket = gpa_bucket_of(ptr);
+  int idx = gpa_size_class(bucket->bucket_size);
+  poison(ptr, bucket->bucket_size);
+
+  bool was_full = gpa_bucket_full(bucket);
+  GPAFreeSlot *slot = (GPAFreeSlot *)ptr;
+  slot->next = bucket->free_list;
+  bucket->free_list = slot;
+  bucket->live--;
+  if (was_full)
+    gpa_bucket_link(gpa, idx, bucket);
+
+  if (bucket->live != 0)
+    return;
+  // the last page of a class stays mapped so alloc/free churn doesn't mmap,
+  // the others decay
+  bucket->empty_epoch = gpa->decay_epoch;
+  bool last_page = gpa->buckets[idx] == bucket && bucket->prev == NULL;
+  if (gpa->decay_ms != 0) {
+    gpa_decay_tick(gpa);
+  } else if (!last_page) {
+    gpa_bucket_unlink(gpa, idx, bucket);
+    STAT(gpa->class_pages[idx] -= bucket->slab_pages);
+    gpa_page_free(gpa, bucket);
+  }
+}
+
+static void gpa_free(Allocator *self, MemoryBlock memory) {
+  GeneralPurposeAllocator *gpa = (GeneralPurposeAllocator *)self;
+  if (memory.size > GPA_MAX_SMALL) {
+    STAT(counters_free(&gpa->counters, memory.size));
+    gpa_large_free(gpa, memory);
+    return;
+  }
+  STAT(counters_free(&gpa->counters, gpa_bucket_of(memory.ptr)->bucket_size));
+  gpa_small_free(gpa, memory.ptr);
+}
+
+// large blocks are their own mapping, mremap without MREMAP_MAYMOVE grows
+// them in place when the pages after them are free
+static bool gpa_large_resize(GeneralPurposeAllocator *gpa, MemoryBlock *memory,
+                             size_t new_size) {
+  // has to stay large, free tells small from large by size
+  if (new_size <= GPA_MAX_SMALL || new_size > ALLOC_SIZE_MAX)
+    return false;
+
+  size_t old_mapped = (memory->size + 4095) & ~(size_t)4095;
+  size_t new_mapped = (new_size + 4095) & ~(size_t)4095;
+  if (new_mapped > old_mapped && gpa_over_limit(gpa, new_mapped - old_mapped))
+    return false;
+  if (new_mapped != old_mapped) {
+    STAT_SYSCALL(mremaps);
+    if (mremap(memory->ptr, old_mapped, new_mapped, 0) == MAP_FAILED)
+      return false;
+  }
+  if (new_mapped > old_mapped)
+    poison((char *)memory->ptr + old_mapped, new_mapped - old_mapped);
+  gpa->used_pages += (new_mapped >> 12) - (old_mapped >> 12);
+  STAT(counters_resize(&gpa->counters, memory->size, new_size));
+  memory->size = new_size;
+  return true;
+}
+
+static bool gpa_resize(Allocator *self, MemoryBlock *memory,
+                       uint8_t log2_align, size_t new_size) {
+  (void)log2_align; // the slot is already aligned for the old block
+  if (memory->size > GPA_MAX_SMALL)
+    return gpa_large_resize((GeneralPurposeAllocator *)self, memory, new_size);
+
+  // resize can only happen within the slot
+  // for different-bucket resize, use alloc+free on callsite
+  GPABucket *bucket = gpa_bucket_of(memory->ptr);
+  if (new_size > bucket->bucket_size) {
+    return false;
+  }
+
+  if (new_size < memory->size) {
+    poison((char *)memory->ptr + new_size, memory->size - new_size);
+  }
+  memory->size = new_size;
+  return true;
+}
+
+// the kernel only keeps page alignment when it moves a mapping
+static inline bool gpa_large_movable(MemoryBlock memory, uint8_t log2_align,
+                                     size_t new_size) {
+  return memory.size > GPA_MAX_SMALL && new_size > GPA_MAX_SMALL &&
+         log2_align <= 12;
+}
+
+// a NULL block if the pages can't be had, the old block is still there then
+static MemoryBlock gpa_large_move(GeneralPurposeAllocator *gpa,
+                                  MemoryBlock memory, size_t new_size) {
+  if (new_size > ALLOC_SIZE_MAX)
+    return (MemoryBlock){NULL, 0};
+  size_t old_mapped = (memory.size + 4095) & ~(size_t)4095;
+  size_t new_mapped = (new_size + 4095) & ~(size_t)4095;
+  if (new_mapped > old_mapped && gpa_over_limit(gpa, new_mapped - old_mapped))
+    return (MemoryBlock){NULL, 0};
+  STAT_SYSCALL(mremaps);
+  void *ptr = mremap(memory.ptr, old_mapped, new_mapped, MREMAP_MAYMOVE);
+  if (ptr == MAP_FAILED)
+    return (MemoryBlock){NULL, 0};
+  if (new_mapped > old_mapped)
+    poison((char *)ptr + old_mapped, new_mapped - old_mapped);
+  gpa->used_pages += (new_mapped >> 12) - (old_mapped >> 12);
+  STAT(counters_resize(&gpa->counters, memory.size, new_size));
+  return (MemoryBlock){ptr, new_size};
+}
+
+// large to large lets the kernel move the pages instead of copying them,
+// everything else is resize in place or alloc + copy + free
+static MemoryBlock gpa_remap(Allocator *self, MemoryBlock memory,
+                             uint8_t log2_align, size_t new_size) {
+  if (self->vtable->resize(self, &memory, log2_align, new_size))
+    return memory;
+  if (gpa_large_movable(memory, log2_align, new_size))
+    return gpa_large_move((GeneralPurposeAllocator *)self, memory, new_size);
+
+  MemoryBlock moved = self->vtable->alloc(self, new_size, log2_align);
+  if (moved.ptr == NULL)
+    return moved;
+  size_t keep = memory.size < new_size ? memory.size : new_size;
+  memcpy(moved.ptr, memory.ptr, keep);
+  self->vtable->free(self, memory);
+  return moved;
+}
+
+static size_t gpa_alloc_many(Allocator *self, size_t size, uint8_t log2_align,
+                             void **out, size_t count) {
+  GeneralPurposeAllocator *gpa = (GeneralPurposeAllocator *)self;
+  int bucket_index = gpa_aligned_class(size, log2_align);
+  if (bucket_index == GPA_CLASSES)
+    return generic_alloc_many(self, size, log2_align, out, count);
+
+  size_t bucket_size = gpa_class_sizes[bucket_index];
+  size_t done = gpa_small_alloc_many(gpa, bucket_index, out, count);
+  if (done < count) {
+    for (size_t i = 0; i < done; i++) {
+      gpa_small_free(gpa, out[i]);
+    }
+    return 0;
+  }
+  STAT(counters_alloc(&gpa->counters, size * count, bucket_size * count));
+  STAT(gpa->counters.allocs += count - 1);
+  return bucket_size;
+}
+
+// no indirect call per block, the page lookup is per block either way
+static void gpa_free_many(Allocator *self, size_t size, void **ptrs,
+                          size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    gpa_free(self, (MemoryBlock){ptrs[i], size});
+  }
+}
+
+static void gpa_stats(Allocator *self, AllocatorStats *out) {
+  (void)self;
+  stats_init(out);
+#if ZALLOC_STATS
+  GeneralPurposeAllocator *gpa = (GeneralPurposeAllocator *)self;
+  out->counters = gpa->counters;
+  memcpy(out->class_pages, gpa->class_pages, sizeof(gpa->class_pages));
+#endif
+}
+
+AllocatorVTable gpa_vtable = {.alloc = gpa_alloc,
+                              .free = gpa_free,
+                              .resize = gpa_resize,
+                              .remap = gpa_remap,
+                              .stats = gpa_stats,
+                              .alloc_many = gpa_alloc_many,
+                              .free_many = gpa_free_many,
+                              .alloc_zeroed = gpa_alloc_zeroed};
+
+static void gpa_init(GeneralPurposeAllocator *gpa,
+                     const AllocatorVTable *vtable) {
+  gpa->base.vtable = vtable;
+  for (int i = 0; i < GPA_CLASSES; i++) {
+    gpa->buckets[i] = NULL;
+  }
+  gpa->segments = NULL;
+  gpa->all_segments = NULL;
+  gpa->pages = &page_allocator;
+  memset(gpa->large_cache, 0, sizeof(gpa->large_cache));
+  gpa->large_cached = 0;
+  gpa->large_dirty = 0;
+  gpa->large_cache_limit = 64 << 20;
+  gpa->large_dirty_limit = 16 << 20;
+  gpa->large_age = 0;
+  gpa->used_pages = 0;
+  gpa->page_limit = UINT32_MAX;
+  gpa->decay_ms = GPA_DECAY_MS;
+  gpa->decay_epoch = 0;
+  gpa->decay_next = gpa_clock_ms() + GPA_DECAY_MS;
+  STAT(memset(&gpa->counters, 0, sizeof(gpa->counters)));
+  STAT(memset(gpa->class_pages, 0, sizeof(gpa->class_pages)));
+}
+
+// unmaps the cached large mappings and every segment, the gpa may live in
+// one of them. large blocks still in use are mappings of their own and stay
+static void gpa_release(GeneralPurposeAllocator *gpa) {
+  for (int bin = 0; bin < GPA_LARGE_BINS; bin++) {
+    for (int i = 0; i < GPA_LARGE_BIN_SLOTS; i++) {
+      if (gpa->large_cache[bin][i].ptr != NULL)
+        gpa_large_evict(gpa, &gpa->large_cache[bin][i]);
+    }
+  }
+  PageAllocator *pages = gpa->pages;
+  GPASegment *segment = gpa->all_segments;
+  while (segment != NULL) {
+    GPASegment *next = segment->all_next;
+    pages->vtable->unmap(pages, segment, SEGMENT_SIZE, SEGMENT_LOG2);
+    segment = next;
+  }
+}
+
+// for embedding the gpa in a struct of your own
+Allocator *init_gpa_allocator(GeneralPurposeAllocator *gpa) {
+  gpa_init(gpa, &gpa_vtable);
+  return (Allocator *)gpa;
+}
+
+// the gpa allocates itself from its own slots. nothing points back at the
+// struct, so the bootstrap copy on the stack can simply be moved over
+Allocator *create_gpa_allocator_with_pages(PageAllocator *pages) {
+  GeneralPurposeAllocator bootstrap;
+  gpa_init(&bootstrap, &gpa_vtable);
+  bootstrap.pages = pages;
+  MemoryBlock self = gpa_alloc(&bootstrap.base,
+                               sizeof(GeneralPurposeAllocator), DEFAULT_ALIGN);
+  if (self.ptr == NULL)
+    return NULL;
+  memcpy(self.ptr, &bootstrap, sizeof(GeneralPurposeAllocator));
+  return (Allocator *)self.ptr;
+}
+
+Allocator *create_gpa_allocator() {
+  return create_gpa_allocator_with_pages(&page_allocator);
+}
+
+// how much of the block can really be used: its whole slot for small blocks,
+// up to the end of the last page for large ones. resize to that never fails
+size_t gpa_usable_size(MemoryBlock memory) {
+  if (memory.size > GPA_MAX_SMALL)
+    return (memory.size + 4095) & ~(size_t)4095;
+  return gpa_bucket_of(memory.ptr)->bucket_size;
+}
+
+// like zig's requested_memory_limit, counted in pages: a 4K page for every
+// page of small slots in use and the mapping of every live large block.
+// past limit bytes alloc hands back NULL blocks and growing resizes fail
+void gpa_set_memory_limit(Allocator *allocator, size_t limit) {
+  ((GeneralPurposeAllocator *)allocator)->page_limit =
+      limit >> 12 > UINT32_MAX ? UINT32_MAX : (uint32_t)(limit >> 12);
+}
+
+// how long an empty page may wait for reuse before its memory goes back, 0
+// to give it back right away. 0 also purges every page waiting now
+void gpa_set_decay(Allocator *allocator, uint32_t decay_ms) {
+  GeneralPurposeAllocator *gpa = (GeneralPurposeAllocator *)allocator;
+  gpa->decay_ms = decay_ms;
+  gpa->decay_next = gpa_clock_ms() + decay_ms;
+  if (decay_ms == 0)
+    gpa_decay_sweep(gpa, 0);
+}
+
+// purges what is due, for a gpa that went idle: from an idle loop or a timer
+void gpa_decay(Allocator *allocator) {
+  gpa_decay_tick((GeneralPurposeAllocator *)allocator);
+}
+
+// how many bytes of freed large mappings to keep (limit), and how many of
+// those to keep without madvise (dirty_limit). the thread-safe gpa must not
+// be in use yet
+void gpa_set_large_cache(Allocator *allocator, size_t limit,
+                         size_t dirty_limit) {
+  GeneralPurposeAllocator *gpa = (GeneralPurposeAllocator *)allocator;
+  gpa->large_cache_limit = limit;
+  gpa->large_dirty_limit = dirty_limit;
+  while (gpa->large_cached > gpa->large_cache_limit)
+    gpa_large_evict(gpa, gpa_large_oldest(gpa, false));
+  while (gpa->large_dirty > gpa->large_dirty_limit)
+    gpa_large_purge(gpa, gpa_large_oldest(gpa, true));
+}
+
+void test_gpa(Allocator *allocator) {
+  GeneralPurposeAllocator *gpa = (GeneralPurposeAllocator *)allocator;
+
+  // smallest class holds a free list link
+  MemoryBlock str1 = allocator->vtable->alloc(allocator, 1, DEFAULT_ALIGN);
+  assert(str1.ptr != NULL);
+  assert(str1.size == 8);
+  assert(gpa->buckets[0] != NULL);
+  assert(gpa->buckets[0]->bucket_size == 8);
+  *(char *)str1.ptr = 'a';
+
+  assert(log2_ceil(0) == 0 && log2_ceil(1) == 0 && log2_ceil(3) == 2);
+  assert(log2_ceil(4096) == 12 && log2_ceil(4097) == 13);
+  assert(log2_floor(1) == 0 && log2_floor(4095) == 11);
+  assert(log2_floor((size_t)1 << 63) == 63);
+
+  // classes are a quarter of a doubling apart, not the next power of two
+  assert(gpa_size_class(20) == 2 && gpa_class_sizes[2] == 24);
+  assert(gpa_class_sizes[gpa_size_class(33)] == 40);
+  assert(gpa_class_sizes[gpa_size_class(257)] == 320);
+  assert(gpa_class_sizes[gpa_size_class(1025)] == 1280);
+  for (size_t size = 1; size <= GPA_MAX_SMALL; size++) {
+    int cls = gpa_size_class(size);
+    assert(gpa_class_sizes[cls] >= size);
+    assert(cls == 0 || gpa_class_sizes[cls - 1] < size);
+  }
+
+  // every class fills its slab to within 1/64
+  for (int cls = 0; cls < GPA_CLASSES; cls++) {
+    size_t slab = (size_t)gpa_slab_pages[cls] << 12;
+    assert(slab % gpa_class_sizes[cls] < slab / 64);
+  }
+
+  // 1536 byte slots fill three pages exactly, and slots past the first page
+  // still find the slab's descriptor. the first slab is shared with the gpa
+  // itself, the next one is all ours
+  Allocator *slabs = create_gpa_allocator();
+  GeneralPurposeAllocator *slabs_gpa = (GeneralPurposeAllocator *)slabs;
+  MemoryBlock slot = slabs->vtable->alloc(slabs, 1500, DEFAULT_ALIGN);
+  GPABucket *shared = gpa_bucket_of(slot.ptr);
+  while (gpa_bucket_of(slot.ptr) == shared)
+    slot = slabs->vtable->alloc(slabs, 1500, DEFAULT_ALIGN);
+  GPABucket *slab = gpa_bucket_of(slot.ptr);
+  uint32_t slab_used = slabs_gpa->used_pages;
+  assert(slab->slab_pages == 3 && slot.ptr == gpa_bucket_page(slab));
+  for (int i = 1; i < 8; i++) {
+    slot = slabs->vtable->alloc(slabs, 1500, DEFAULT_ALIGN);
+    assert(gpa_bucket_of(slot.ptr) == slab);
+  }
+  assert((char *)slot.ptr + 1536 == gpa_bucket_end(slab));
+  slot = slabs->vtable->alloc(slabs, 1500, DEFAULT_ALIGN);
+  assert(gpa_bucket_of(slot.ptr) != slab);
+  assert(slabs_gpa->used_pages == slab_used + 3);
+
+  MemoryBlock str2 = allocator->vtable->alloc(allocator, 20, DEFAULT_ALIGN);
+  assert(str2.ptr != NULL);
+  assert(str2.size == 24);
+  assert(gpa->buckets[2] != NULL);
+  memcpy(str2.ptr, "bucket2\n", 8);
+
+  MemoryBlock str3 = allocator->vtable->alloc(allocator, 512, DEFAULT_ALIGN);
+  int class512 = gpa_size_class(512);
+  assert(str3.ptr != NULL);
+  assert(gpa->buckets[class512] != NULL);
+  assert(gpa->buckets[class512]->bucket_size == 512);
+  memcpy(str3.ptr, "bucket512\n", 10);
+
+  // can't resize to different bucket, use alloc+free instead
+  bool resize1 = allocator->vtable->resize(allocator, &str1, DEFAULT_ALIGN, 9);
+  assert(resize1 == false);
+  bool resize2 = allocator->vtable->resize(allocator, &str2, DEFAULT_ALIGN, 24);
+  assert(resize2 == true);
+  assert(str2.size == 24);
+  assert(gpa_usable_size(str2) == 24);
+  bool resize2_2 =
+      allocator->vtable->resize(allocator, &str2, DEFAULT_ALIGN, 1);
+  assert(resize2_2 == true);
+  assert(((char *)str2.ptr)[0] == 'b');
+  assert(!ZALLOC_SAFETY || ((char *)str2.ptr)[1] == (char)0xAA);
+
+  MemoryBlock str4[8];
+  GPABucket *initial_bucket = gpa->buckets[class512];
+  assert(gpa->buckets[class512]->prev == NULL);
+  assert(gpa->buckets[class512]->live == 1);
+
+  // no header in the page, 8 slots of 512 fit. does overflowing create new page
+  for (int i = 0; i < 8; i++) {
+    str4[i] = allocator->vtable->alloc(allocator, 500, DEFAULT_ALIGN);
+  }
+  assert(str4[6].ptr == (char *)gpa_bucket_page(initial_bucket) + 3584);
+  assert(gpa->buckets[class512] != initial_bucket);
+  assert(gpa->buckets[class512]->prev == NULL); // full pages are unlinked
+  assert(gpa->buckets[class512]->live == 1);
+  GPABucket *overflow_bucket = gpa->buckets[class512];
+
+  // freeing into a full page links it back in
+  allocator->vtable->free(allocator, str3);
+  assert(gpa->buckets[class512] == initial_bucket);
+  assert(initial_bucket->prev == overflow_bucket);
+  assert(initial_bucket->live == 7);
+
+  // the page is found from the pointer, not the head of the class
+  allocator->vtable->free(allocator, str4[7]);
+  assert(overflow_bucket->live == 0); // empty, it waits out its decay
+  assert(initial_bucket->prev == overflow_bucket);
+  gpa_set_decay(allocator, 0);
+  assert(initial_bucket->prev == NULL); // went back to its segment
+  gpa_set_decay(allocator, GPA_DECAY_MS);
+  for (int i = 0; i < 7; i++) {
+    allocator->vtable->free(allocator, str4[i]);
+  }
+  assert(gpa->buckets[class512] == initial_bucket); // last page stays mapped
+  assert(initial_bucket->live == 0);
+
+  // user data full of 0xAA doesn't look like a free page
+  MemoryBlock poisoned =
+      allocator->vtable->alloc(allocator, 512, DEFAULT_ALIGN);
+  memset(poisoned.ptr, 0xAA, poisoned.size);
+  assert(gpa_bucket_of(poisoned.ptr)->live == 1);
+  allocator->vtable->free(allocator, poisoned);
+
+  MemoryBlock str5 = allocator->vtable->alloc(allocator, 1, DEFAULT_ALIGN);
+  *(char *)str5.ptr = 'b';
+  allocator->vtable->free(allocator, str1);
+  allocator->vtable->free(allocator, str5);
+
+  // freed slots are reused, last freed first
+  MemoryBlock str7 = allocator->vtable->alloc(allocator, 3, DEFAULT_ALIGN);
+  assert(str7.ptr == str5.ptr);
+  // link is poisoned on reuse
+  assert(!ZALLOC_SAFETY || ((char *)str7.ptr)[0] == (char)0xAA);
+  MemoryBlock str8 = allocator->vtable->alloc(allocator, 8, DEFAULT_ALIGN);
+  assert(str8.ptr == str1.ptr);
+  assert(gpa_bucket_of(str8.ptr)->free_list == NULL);
+
+  // steady-state churn doesn't map new pages
+  GPABucket *churn_bucket = gpa->buckets[class512];
+  for (int i = 0; i < 10000; i++) {
+    MemoryBlock tmp = allocator->vtable->alloc(allocator, 500, DEFAULT_ALIGN);
+    allocator->vtable->free(allocator, tmp);
+  }
+  assert(gpa->buckets[class512] == churn_bucket);
+
+  // large allocations
+  MemoryBlock str6 = allocator->vtable->alloc(allocator, 4096, DEFAULT_ALIGN);
+  assert(str6.ptr != NULL);
+  assert(str6.size == 4096);
+  allocator->vtable->free(allocator, str6);
+  MemoryBlock odd = allocator->vtable->alloc(allocator, 5000, DEFAULT_ALIGN);
+  assert(gpa_usable_size(odd) == 8192);
+  assert(allocator->vtable->resize(allocator, &odd, DEFAULT_ALIGN, 8192));
+  allocator->vtable->free(allocator, odd);
+
+  // under a page is still large, it grows to the end of its page in place
+  // and can shrink down to just past the small classes
+  MemoryBlock sub_page = allocator->vtable->alloc(allocator, 3000, DEFAULT_ALIGN);
+  void *sub_page_ptr = sub_page.ptr;
+  assert(gpa_usable_size(sub_page) == 4096);
+  assert(allocator->vtable->resize(allocator, &sub_page, DEFAULT_ALIGN, 3500));
+  assert(allocator->vtable->resize(allocator, &sub_page, DEFAULT_ALIGN,
+                                   gpa_usable_size(sub_page)));
+  assert(sub_page.ptr == sub_page_ptr && sub_page.size == 4096);
+  assert(allocator->vtable->resize(allocator, &sub_page, DEFAULT_ALIGN,
+                                   GPA_MAX_SMALL + 1));
+  assert(!allocator->vtable->resize(allocator, &sub_page, DEFAULT_ALIGN,
+                                    GPA_MAX_SMALL));
+  sub_page = allocator->vtable->remap(allocator, sub_page, DEFAULT_ALIGN, 4000);
+  assert(sub_page.ptr == sub_page_ptr && sub_page.size == 4000);
+  allocator->vtable->free(allocator, sub_page);
+
+  // slots are aligned to the lowest bit of their class, over-alignment picks
+  // a bigger class
+  for (int i = 0; i < 100; i++) {
+    MemoryBlock slot = allocator->vtable->alloc(allocator, 48, DEFAULT_ALIGN);
+    assert(slot.size == 48);
+    assert((uintptr_t)slot.ptr % 16 == 0);
+  }
+  MemoryBlock aligned0 = allocator->vtable->alloc(allocator, 48, 6);
+  assert(aligned0.size == 64);
+  assert((uintptr_t)aligned0.ptr % 64 == 0);
+  MemoryBlock aligned1 = allocator->vtable->alloc(allocator, 24, 5);
+  assert(aligned1.size == 32);
+  assert((uintptr_t)aligned1.ptr % 32 == 0);
+  MemoryBlock aligned2 = allocator->vtable->alloc(allocator, 8, 7);
+  assert(aligned2.size == 128);
+  assert((uintptr_t)aligned2.ptr % 128 == 0);
+  allocator->vtable->free(allocator, aligned2);
+
+  // large ones are at least as big as their alignment
+  MemoryBlock aligned3 = allocator->vtable->alloc(allocator, 100, 12);
+  assert(aligned3.size == 4096);
+  assert((uintptr_t)aligned3.ptr % 4096 == 0);
+  allocator->vtable->free(allocator, aligned3);
+  MemoryBlock aligned4 = allocator->vtable->alloc(allocator, 5000, 16);
+  assert(aligned4.size == 65536);
+  assert((uintptr_t)aligned4.ptr % 65536 == 0);
+  memset(aligned4.ptr, 4, aligned4.size);
+  allocator->vtable->free(allocator, aligned4);
+
+  // remap moves small blocks across classes and keeps the data
+  MemoryBlock small = allocator->vtable->alloc(allocator, 20, DEFAULT_ALIGN);
+  memcpy(small.ptr, "remapped\0", 9);
+  small = allocator->vtable->remap(allocator, small, DEFAULT_ALIGN, 1000);
+  assert(small.size == 1024);
+  small = allocator->vtable->remap(allocator, small, DEFAULT_ALIGN, 1100);
+  assert(small.size == 1280);
+  assert(strcmp(small.ptr, "remapped") == 0);
+
+  // small to large and back
+  MemoryBlock big = allocator->vtable->remap(allocator, small, DEFAULT_ALIGN,
+                                             1 << 20);
+  assert(big.size == 1 << 20);
+  assert(strcmp(big.ptr, "remapped") == 0);
+  memset((char *)big.ptr + 9, 'x', big.size - 9);
+
+  // large blocks grow through mremap, no copy at the call site
+  big = allocator->vtable->remap(allocator, big, DEFAULT_ALIGN, 8 << 20);
+  assert(big.size == 8 << 20);
+  assert(strcmp(big.ptr, "remapped") == 0);
+  assert(((char *)big.ptr)[(1 << 20) - 1] == 'x');
+  assert(!ZALLOC_SAFETY || ((char *)big.ptr)[1 << 20] == (char)0xAA);
+  bool shrunk = allocator->vtable->resize(allocator, &big, DEFAULT_ALIGN,
+                                          8192);
+  assert(shrunk == true);
+  assert(big.size == 8192);
+  small = allocator->vtable->remap(allocator, big, DEFAULT_ALIGN, 16);
+  assert(small.size == 16);
+  assert(memcmp(small.ptr, "remapped", 8) == 0);
+  allocator->vtable->free(allocator, small);
+
+  // freed large mappings are reused, start with an empty cache
+  gpa_set_large_cache(allocator, 0, 0);
+  gpa_set_large_cache(allocator, 64 << 20, 16 << 20);
+  size_t cached = gpa->large_cached;
+  assert(cached == 0);
+  MemoryBlock large1 =
+      allocator->vtable->alloc(allocator, 60000, DEFAULT_ALIGN);
+  allocator->vtable->free(allocator, large1);
+  assert(gpa->large_cached == cached + 61440);
+  MemoryBlock large2 =
+      allocator->vtable->alloc(allocator, 60000, DEFAULT_ALIGN);
+  assert(large2.ptr == large1.ptr);
+  assert(!ZALLOC_SAFETY || ((char *)large2.ptr)[59999] == (char)0xAA);
+  assert(gpa->large_cached == cached);
+
+  // a bigger mapping from the same bin is trimmed to the request
+  allocator->vtable->free(allocator, large2);
+  MemoryBlock large3 =
+      allocator->vtable->alloc(allocator, 40000, DEFAULT_ALIGN);
+  assert(large3.ptr == large1.ptr);
+  assert(gpa->large_cached == cached);
+  allocator->vtable->free(allocator, large3);
+  assert(gpa->large_cached == cached + 40960);
+
+  // past the dirty budget mappings get madvise'd but stay cached
+  gpa_set_large_cache(allocator, 64 << 20, 0);
+  assert(gpa->large_dirty == 0);
+  assert(gpa->large_cached == cached + 40960);
+  MemoryBlock large4 =
+      allocator->vtable->alloc(allocator, 40000, DEFAULT_ALIGN);
+  assert(large4.ptr == large3.ptr);
+  memset(large4.ptr, 4, large4.size);
+  allocator->vtable->free(allocator, large4);
+
+  // past the retention limit the oldest mappings are unmapped
+  gpa_set_large_cache(allocator, 0, 0);
+  assert(gpa->large_cached == 0);
+  MemoryBlock large5 =
+      allocator->vtable->alloc(allocator, 40000, DEFAULT_ALIGN);
+  allocator->vtable->free(allocator, large5);
+  assert(gpa->large_cached == 0);
+  gpa_set_large_cache(allocator, 64 << 20, 16 << 20);
+
+  // uncomment to check whether mem has been munmap'd
+  // memset(str6.ptr, 1, 1);
+
+  // metadata is out of band: 2048-byte slots pack two to a page and the
+  // allocator itself sits in one of them
+  assert(gpa_bucket_of(gpa)->bucket_size ==
+         gpa_class_sizes[gpa_size_class(sizeof(GeneralPurposeAllocator))]);
+  MemoryBlock half1 = allocator->vtable->alloc(allocator, 2000, DEFAULT_ALIGN);
+  MemoryBlock half2 = allocator->vtable->alloc(allocator, 2000, DEFAULT_ALIGN);
+  assert(gpa_bucket_of(half1.ptr) == gpa_bucket_of(half2.ptr) ||
+         gpa_bucket_of(half1.ptr) == gpa_bucket_of(gpa));
+  allocator->vtable->free(allocator, half1);
+  allocator->vtable->free(allocator, half2);
+
+  // the gpa can also be embedded in a caller's struct
+  struct {
+    int id;
+    GeneralPurposeAllocator gpa;
+  } owner;
+  Allocator *embedded = init_gpa_allocator(&owner.gpa);
+  MemoryBlock str9 = embedded->vtable->alloc(embedded, 100, DEFAULT_ALIGN);
+  assert(gpa_segment_of(str9.ptr) == owner.gpa.segments);
+  assert(((uintptr_t)str9.ptr & 4095) == 0); // first slot starts the page
+  embedded->vtable->free(embedded, str9);
+
+  printf("all gpa allocator tests passed\n");
+}
+
+void test_page_allocators(void) {
+  // a region hands out aligned runs first fit, its header comes off the top
+  size_t size = 64 * 4096;
+  char *buffer = map_pages(size, 12);
+  PageAllocator *region = create_region_page_allocator(buffer + 100, size - 100);
+  char *a = region->vtable->map(region, 4096, 12);
+  char *b = region->vtable->map(region, 5000, 12);
+  char *c = region->vtable->map(region, 4096, 14);
+  assert(a > buffer && c + 4096 <= buffer + size);
+  assert(b == a + 4096); // two pages
+  assert((uintptr_t)c % 16384 == 0);
+  region->vtable->unmap(region, b, 5000, 12);
+  assert(region->vtable->map(region, 8192, 12) == b);
+
+  // arena chunks stay inside the region, and go back to it
+  Allocator *arena = create_arena_allocator_with_pages(region);
+  for (int i = 0; i < 20; i++) {
+    MemoryBlock block = arena->vtable->alloc(arena, 1000, DEFAULT_ALIGN);
+    assert((char *)block.ptr > buffer && (char *)block.ptr < buffer + size);
+  }
+  char *first = (char *)((ArenaAllocator *)arena)->first;
+  arena->vtable->free(arena, (MemoryBlock){NULL, 0});
+  assert(region->vtable->map(region, 4096, 12) == first);
+
+  // a memfd region is shared memory, a second mapping of the fd is what a
+  // process on the other end would see
+  size_t shared_size = (size_t)16 << 20;
+  PageAllocator *shared = create_memfd_page_allocator("zalloc", shared_size);
+  Allocator *shared_arena = create_arena_allocator_with_pages(shared);
+  MemoryBlock hello = shared_arena->vtable->alloc(shared_arena, 6, 3);
+  memcpy(hello.ptr, "hello", 6);
+  char *view = mmap(NULL, shared_size, PROT_READ, MAP_SHARED,
+                    page_region_fd(shared), 0);
+  assert(view != MAP_FAILED);
+  assert(strcmp(view + page_region_offset(shared, hello.ptr), "hello") == 0);
+  munmap(view, shared_size);
+
+  // gpa segments find a 4 MiB aligned run in it
+  Allocator *shared_gpa = create_gpa_allocator_with_pages(shared);
+  MemoryBlock slot = shared_gpa->vtable->alloc(shared_gpa, 64, DEFAULT_ALIGN);
+  assert((char *)slot.ptr > (char *)shared);
+  assert((char *)slot.ptr < (char *)shared + shared_size);
+  shared_gpa->vtable->free(shared_gpa, slot);
+  shared_arena->vtable->free(shared_arena, (MemoryBlock){NULL, 0});
+
+  // huge page chunks round up to 2 MiB, hugetlb or not
+  Allocator *huge = create_arena_allocator_with_pages(&huge_page_allocator);
+  ArenaChunk *chunk = ((ArenaAllocator *)huge)->first;
+  assert(chunk->size == HUGE_PAGE_SIZE);
+  assert((uintptr_t)chunk % HUGE_PAGE_SIZE == 0);
+  MemoryBlock big = huge->vtable->alloc(huge, 1 << 20, DEFAULT_ALIGN);
+  assert(((ArenaAllocator *)huge)->current == chunk);
+  memset(big.ptr, 1, big.size);
+  huge->vtable->free(huge, (MemoryBlock){NULL, 0});
+
+  munmap(buffer, size);
+  printf("all page allocator tests passed\n");
+}
+
+// thread-safe gpa: every thread keeps a small magazine of slots per size class
+// in front of a shared gpa, the lock is only taken to refill a batch. flushed
+// slots go onto their page's lock-free remote free stack instead, and pages
+// with remote frees are queued until the next refill drains them
+#define GPA_CACHE_SLOTS 32
+#define GPA_CACHE_BATCH 16
+
+typedef struct ThreadSafeGPA ThreadSafeGPA;
+
+typedef struct GPAThreadCache {
+  ThreadSafeGPA *owner;
+  struct GPAThreadCache *prev; // every live cache of the owner
+  struct GPAThreadCache *next;
+  int count[GPA_CLASSES];
+  void *slots[GPA_CLASSES][GPA_CACHE_SLOTS];
+} GPAThreadCache;
+
+struct ThreadSafeGPA {
+  GeneralPurposeAllocator central; // only touched with lock held
+  pthread_mutex_t lock;
+  pthread_key_t cache_key;
+  // thread exit takes this one, so a flush never waits for the central lock
+  pthread_mutex_t caches_lock;
+  GPAThreadCache *caches;
+  _Atomic(GPABucket *) pending; // pages with a non-empty remote_free
+};
+
+_Static_assert(sizeof(ThreadSafeGPA) <= GPA_MAX_SMALL,
+               "the thread-safe gpa must fit one of its own slots");
+
+// lock-free push of a chain of slots that all live in bucket. only the push
+// that finds the stack empty queues the page, a page is never queued twice
+// because the stack is only emptied after the page was taken off the queue
+static void gpa_remote_free(ThreadSafeGPA *ts, GPABucket *bucket,
+                            GPAFreeSlot *head, GPAFreeSlot *tail) {
+  GPAFreeSlot *old =
+      atomic_load_explicit(&bucket->remote_free, memory_order_relaxed);
+  do {
+    tail->next = old;
+  } while (!atomic_compare_exchange_weak_explicit(
+      &bucket->remote_free, &old, head, memory_order_release,
+      memory_order_relaxed));
+  if (old != NULL)
+    return;
+
+  GPABucket *pending = atomic_load_explicit(&ts->pending, memory_order_relaxed);
+  do {
+    bucket->pending_next = pending;
+  } while (!atomic_compare_exchange_weak_explicit(
+      &ts->pending, &pending, bucket, memory_order_release,
+      memory_order_relaxed));
+}
+
+// called with the lock held, single consumer of every remote stack
+static void gpa_drain_remote_frees(ThreadSafeGPA *ts) {
+  GPABucket *bucket =
+      atomic_exchange_explicit(&ts->pending, NULL, memory_order_acquire);
+  while (bucket != NULL) {
+    // the last slot can unmap the page, read everything we need first
+    GPABucket *next = bucket->pending_next;
+    size_t bucket_size = bucket->bucket_size;
+    GPAFreeSlot *slot =
+        atomic_exchange_explicit(&bucket->remote_free, NULL,
+                                 memory_order_acquire);
+    while (slot != NULL) {
+      GPAFreeSlot *slot_next = slot->next;
+      gpa_free(&ts->central.base, (MemoryBlock){slot, bucket_size});
+      slot = slot_next;
+    }
+    bucket = next;
+  }
+}
+
+// oldest slots go back first, the recently freed (cache-hot) ones stay.
+// consecutive slots from the same page are pushed with a single CAS
+static void gpa_cache_flush(GPAThreadCache *cache, int idx, int n) {
+  int i = 0;
+  while (i < n) {
+    GPAFreeSlot *head = cache->slots[idx][i];
+    GPAFreeSlot *tail = head;
+    GPABucket *bucket = gpa_bucket_of(head);
+    for (i++; i < n && gpa_bucket_of(cache->slots[idx][i]) == bucket; i++) {
+      tail->next = cache->slots[idx][i];
+      tail = tail->next;
+    }
+    gpa_remote_free(cache->owner, bucket, head, tail);
+  }
+  cache->count[idx] -= n;
+  memmove(cache->slots[idx], cache->slots[idx] + n,
+          cache->count[idx] * sizeof(void *));
+}
+
+// runs on thread exit, hands everything cached back to the central pool
+static void gpa_cache_destroy(void *ptr) {
+  GPAThreadCache *cache = (GPAThreadCache *)ptr;
+  ThreadSafeGPA *ts = cache->owner;
+  for (int i = 0; i < GPA_CLASSES; i++) {
+    if (cache->count[i] > 0)
+      gpa_cache_flush(cache, i, cache->count[i]);
+  }
+  pthread_mutex_lock(&ts->caches_lock);
+  if (cache->prev != NULL)
+    cache->prev->next = cache->next;
+  else
+    ts->caches = cache->next;
+  if (cache->next != NULL)
+    cache->next->prev = cache->prev;
+  pthread_mutex_unlock(&ts->caches_lock);
+  free_page_memory(cache, sizeof(GPAThreadCache));
+}
+
+static GPAThreadCache *gpa_thread_cache(ThreadSafeGPA *ts) {
+  GPAThreadCache *cache = pthread_getspecific(ts->cache_key);
+  if (cache != NULL)
+    return cache;
+
+  cache = new_page_memory(sizeof(GPAThreadCache));
+  if (cache == NULL)
+    return NULL;
+  cache->owner = ts;
+  for (int i = 0; i < GPA_CLASSES; i++) {
+    cache->count[i] = 0;
+  }
+  pthread_mutex_lock(&ts->caches_lock);
+  cache->prev = NULL;
+  cache->next = ts->caches;
+  if (cache->next != NULL)
+    cache->next->prev = cache;
+  ts->caches = cache;
+  pthread_mutex_unlock(&ts->caches_lock);
+  pthread_setspecific(ts->cache_key, cache);
+  return cache;
+}
+
+static MemoryBlock gpa_thread_safe_alloc(Allocator *self, size_t size,
+                                         uint8_t log2_align) {
+  ThreadSafeGPA *ts = (ThreadSafeGPA *)self;
+  if (size <= 0) {
+    perror("invalid allocation size");
+    exit(1);
+  }
+
+  // large allocations go to the shared large cache
+  int idx = gpa_aligned_class(size, log2_align);
+  if (idx == GPA_CLASSES) {
+    pthread_mutex_lock(&ts->lock);
+    MemoryBlock block = gpa_alloc(&ts->central.base, size, log2_align);
+    pthread_mutex_unlock(&ts->lock);
+    return block;
+  }
+
+  size_t bucket_size = gpa_class_sizes[idx];
+  GPAThreadCache *cache = gpa_thread_cache(ts);
+  if (cache == NULL)
+    return (MemoryBlock){NULL, 0};
+  if (cache->count[idx] == 0) {
+    // near the limit a refill takes whatever is left
+    pthread_mutex_lock(&ts->lock);
+    gpa_drain_remote_frees(ts);
+    size_t got = gpa_small_alloc_many(&ts->central, idx, cache->slots[idx],
+                                      GPA_CACHE_BATCH);
+    STAT(counters_alloc(&ts->central.counters, bucket_size * got,
+                        bucket_size * got));
+    pthread_mutex_unlock(&ts->lock);
+    if (got == 0)
+      return (MemoryBlock){NULL, 0};
+    cache->count[idx] = got;
+  }
+
+  void *ptr = cache->slots[idx][--cache->count[idx]];
+  return (MemoryBlock){ptr, bucket_size};
+}
+
+// large blocks get the central pool's zeroing, cached slots are cleared here
+static MemoryBlock gpa_thread_safe_alloc_zeroed(Allocator *self, size_t size,
+                                                uint8_t log2_align) {
+  ThreadSafeGPA *ts = (ThreadSafeGPA *)self;
+  if (size > 0 && gpa_aligned_class(size, log2_align) == GPA_CLASSES) {
+    pthread_mutex_lock(&ts->lock);
+    MemoryBlock block = gpa_alloc_zeroed(&ts->central.base, size, log2_align);
+    pthread_mutex_unlock(&ts->lock);
+    return block;
+  }
+  MemoryBlock block = gpa_thread_safe_alloc(self, size, log2_align);
+  if (block.ptr != NULL)
+    memset(block.ptr, 0, block.size);
+  return block;
+}
+
+static void gpa_thread_safe_free(Allocator *self, MemoryBlock memory) {
+  ThreadSafeGPA *ts = (ThreadSafeGPA *)self;
+  if (memory.size > GPA_MAX_SMALL) {
+    pthread_mutex_lock(&ts->lock);
+    gpa_free(&ts->central.base, memory);
+    pthread_mutex_unlock(&ts->lock);
+    return;
+  }
+
+  // bucket_size never changes after the page is created, safe to read
+  GPABucket *bucket = gpa_bucket_of(memory.ptr);
+  int idx = gpa_size_class(bucket->bucket_size);
+  poison(memory.ptr, bucket->bucket_size);
+
+  GPAThreadCache *cache = gpa_thread_cache(ts);
+  if (cache == NULL) {
+    // no page for a cache, the slot goes straight back to its page
+    gpa_remote_free(ts, bucket, memory.ptr, memory.ptr);
+    return;
+  }
+  if (cache->count[idx] == GPA_CACHE_SLOTS)
+    gpa_cache_flush(cache, idx, GPA_CACHE_BATCH);
+  cache->slots[idx][cache->count[idx]++] = memory.ptr;
+}
+
+// what the thread cache holds goes first, the rest comes from the central
+// pool under one lock instead of refill after refill
+static size_t gpa_thread_safe_alloc_many(Allocator *self, size_t size,
+                                         uint8_t log2_align, void **out,
+                                         size_t count) {
+  ThreadSafeGPA *ts = (ThreadSafeGPA *)self;
+  int idx = gpa_aligned_class(size, log2_align);
+  if (idx == GPA_CLASSES)
+    return generic_alloc_many(self, size, log2_align, out, count);
+
+  size_t bucket_size = gpa_class_sizes[idx];
+  GPAThreadCache *cache = gpa_thread_cache(ts);
+  if (cache == NULL)
+    return 0;
+  size_t i = 0;
+  for (; i < count && cache->count[idx] > 0; i++) {
+    out[i] = cache->slots[idx][--cache->count[idx]];
+  }
+  if (i < count) {
+    pthread_mutex_lock(&ts->lock);
+    gpa_drain_remote_frees(ts);
+    size_t got = gpa_small_alloc_many(&ts->central, idx, out + i, count - i);
+    if (got < count - i) {
+      // everything goes back where it came from
+      for (size_t j = 0; j < got; j++) {
+        gpa_small_free(&ts->central, out[i + j]);
+      }
+      pthread_mutex_unlock(&ts->lock);
+      while (i > 0)
+        cache->slots[idx][cache->count[idx]++] = out[--i];
+      return 0;
+    }
+    STAT(counters_alloc(&ts->central.counters, bucket_size * (count - i),
+                        bucket_size * (count - i)));
+    pthread_mutex_unlock(&ts->lock);
+  }
+  return bucket_size;
+}
+
+static void gpa_thread_safe_free_many(Allocator *self, size_t size,
+                                      void **ptrs, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    gpa_thread_safe_free(self, (MemoryBlock){ptrs[i], size});
+  }
+}
+
+// small resizes only read the slot's page header. large ones change the
+// central pool's counters, they are a syscall anyway
+static bool gpa_thread_safe_resize(Allocator *self, MemoryBlock *memory,
+                                   uint8_t log2_align, size_t new_size) {
+  ThreadSafeGPA *ts = (ThreadSafeGPA *)self;
+  if (memory->size <= GPA_MAX_SMALL)
+    return gpa_resize(self, memory, log2_align, new_size);
+  pthread_mutex_lock(&ts->lock);
+  bool resized = gpa_resize(self, memory, log2_align, new_size);
+  pthread_mutex_unlock(&ts->lock);
+  return resized;
+}
+
+static MemoryBlock gpa_thread_safe_remap(Allocator *self, MemoryBlock memory,
+                                         uint8_t log2_align, size_t new_size) {
+  ThreadSafeGPA *ts = (ThreadSafeGPA *)self;
+  if (!gpa_large_movable(memory, log2_align, new_size))
+    return gpa_remap(self, memory, log2_align, new_size);
+  pthread_mutex_lock(&ts->lock);
+  if (!gpa_resize(self, &memory, log2_align, new_size))
+    memory = gpa_large_move(&ts->central, memory, new_size);
+  pthread_mutex_unlock(&ts->lock);
+  return memory;
+}
+
+// counters are the central pool's: slots sitting in thread caches count as
+// live, and caches refill and flush in batches
+static void gpa_thread_safe_stats(Allocator *self, AllocatorStats *out) {
+  ThreadSafeGPA *ts = (ThreadSafeGPA *)self;
+  pthread_mutex_lock(&ts->lock);
+  gpa_stats(self, out);
+  pthread_mutex_unlock(&ts->lock);
+}
+
+AllocatorVTable gpa_thread_safe_vtable = {.alloc = gpa_thread_safe_alloc,
+                                          .free = gpa_thread_safe_free,
+                                          .resize = gpa_thread_safe_resize,
+                                          .remap = gpa_thread_safe_remap,
+                                          .stats = gpa_thread_safe_stats,
+                                          .alloc_many =
+                                              gpa_thread_safe_alloc_many,
+                                          .free_many =
+                                              gpa_thread_safe_free_many,
+                                          .alloc_zeroed =
+                                              gpa_thread_safe_alloc_zeroed};
+
+Allocator *create_thread_safe_gpa_allocator() {
+  GeneralPurposeAllocator bootstrap;
+  gpa_init(&bootstrap, &gpa_thread_safe_vtable);
+  MemoryBlock self =
+      gpa_alloc(&bootstrap.base, sizeof(ThreadSafeGPA), DEFAULT_ALIGN);
+  ThreadSafeGPA *ts = self.ptr;
+  if (ts == NULL)
+    return NULL;
+  if (pthread_key_create(&ts->cache_key, gpa_cache_destroy) != 0) {
+    gpa_release(&bootstrap);
+    return NULL;
+  }
+  memcpy(&ts->central, &bootstrap, sizeof(GeneralPurposeAllocator));
+  pthread_mutex_init(&ts->lock, NULL);
+  pthread_mutex_init(&ts->caches_lock, NULL);
+  ts->caches = NULL;
+  atomic_init(&ts->pending, NULL);
+  return (Allocator *)ts;
+}
+
+// gives back the thread key, every thread's cache and the central pool with
+// the allocator in it. no thread may use it anymore, large blocks still in
+// use stay mapped
+void destroy_thread_safe_gpa_allocator(Allocator *allocator) {
+  ThreadSafeGPA *ts = (ThreadSafeGPA *)allocator;
+  pthread_key_delete(ts->cache_key);
+  GPAThreadCache *cache = ts->caches;
+  while (cache != NULL) {
+    GPAThreadCache *next = cache->next;
+    free_page_memory(cache, sizeof(GPAThreadCache));
+    cache = next;
+  }
+  pthread_mutex_destroy(&ts->lock);
+  pthread_mutex_destroy(&ts->caches_lock);
+  gpa_release(&ts->central);
+}
+
+// gpa_set_memory_limit for the central pool, slots in thread caches count as
+// in use
+void gpa_thread_safe_set_memory_limit(Allocator *allocator, size_t limit) {
+  ThreadSafeGPA *ts = (ThreadSafeGPA *)allocator;
+  pthread_mutex_lock(&ts->lock);
+  gpa_set_memory_limit(&ts->central.base, limit);
+  pthread_mutex_unlock(&ts->lock);
+}
+
+// gpa_set_decay and gpa_decay for the central pool. a page is only empty
+// once the thread caches gave back all its slots
+void gpa_thread_safe_set_decay(Allocator *allocator, uint32_t decay_ms) {
+  ThreadSafeGPA *ts = (ThreadSafeGPA *)allocator;
+  pthread_mutex_lock(&ts->lock);
+  gpa_set_decay(&ts->central.base, decay_ms);
+  pthread_mutex_unlock(&ts->lock);
+}
+
+void gpa_thread_safe_decay(Allocator *allocator) {
+  ThreadSafeGPA *ts = (ThreadSafeGPA *)allocator;
+  pthread_mutex_lock(&ts->lock);
+  gpa_drain_remote_frees(ts);
+  gpa_decay(&ts->central.base);
+  pthread_mutex_unlock(&ts->lock);
+}
+
+typedef struct {
+  Allocator *allocator;
+  int id;
+  MemoryBlock *handoff; // blocks allocated by another thread, freed here
+  int handoff_count;
+} GPATestWorker;
+
+static void *gpa_test_worker(void *arg) {
+  GPATestWorker *worker = (GPATestWorker *)arg;
+  Allocator *allocator = worker->allocator;
+  MemoryBlock live[64] = {0};
+  uint32_t rng = worker->id + 1;
+
+  for (int i = 0; i < 20000; i++) {
+    MemoryBlock *block = &live[i % 64];
+    if (block->ptr != NULL) {
+      for (size_t j = 0; j < block->size; j++) {
+        assert(((unsigned char *)block->ptr)[j] == (unsigned char)worker->id);
+      }
+      allocator->vtable->free(allocator, *block);
+    }
+    rng = rng * 1103515245 + 12345;
+    size_t size = 1 + (rng >> 16) % 2048;
+    *block = allocator->vtable->alloc(allocator, size, DEFAULT_ALIGN);
+    memset(block->ptr, worker->id, block->size);
+  }
+  for (int i = 0; i < 64; i++) {
+    allocator->vtable->free(allocator, live[i]);
+  }
+  for (int i = 0; i < worker->handoff_count; i++) {
+    allocator->vtable->free(allocator, worker->handoff[i]);
+  }
+  return NULL;
+}
+
+static void *gpa_test_consumer(void *arg) {
+  GPATestWorker *worker = (GPATestWorker *)arg;
+  for (int i = 0; i < worker->handoff_count; i++) {
+    worker->allocator->vtable->free(worker->allocator, worker->handoff[i]);
+  }
+  return NULL;
+}
+
+void test_gpa_thread_safe(Allocator *allocator) {
+  ThreadSafeGPA *ts = (ThreadSafeGPA *)allocator;
+
+  // caches are per thread and refill in batches
+  MemoryBlock str1 = allocator->vtable->alloc(allocator, 20, DEFAULT_ALIGN);
+  assert(str1.ptr != NULL);
+  assert(str1.size == 24);
+  GPAThreadCache *cache = pthread_getspecific(ts->cache_key);
+  assert(cache != NULL);
+  assert(cache->count[2] == GPA_CACHE_BATCH - 1);
+  allocator->vtable->free(allocator, str1);
+  assert(cache->count[2] == GPA_CACHE_BATCH);
+  MemoryBlock str2 = allocator->vtable->alloc(allocator, 24, DEFAULT_ALIGN);
+  assert(str2.ptr == str1.ptr); // lifo, stays cache-hot
+  allocator->vtable->free(allocator, str2);
+
+  // blocks allocated here get freed by the workers
+  MemoryBlock handoff[4][100];
+  for (int t = 0; t < 4; t++) {
+    for (int i = 0; i < 100; i++) {
+      handoff[t][i] =
+          allocator->vtable->alloc(allocator, 1 + i * 7, DEFAULT_ALIGN);
+    }
+  }
+
+  pthread_t threads[4];
+  GPATestWorker workers[4];
+  for (int t = 0; t < 4; t++) {
+    workers[t] = (GPATestWorker){allocator, t + 1, handoff[t], 100};
+    pthread_create(&threads[t], NULL, gpa_test_worker, &workers[t]);
+  }
+  for (int t = 0; t < 4; t++) {
+    pthread_join(threads[t], NULL);
+  }
+
+  // exited threads flushed their caches onto remote stacks, drain them
+  gpa_cache_destroy(cache);
+  pthread_setspecific(ts->cache_key, NULL);
+  assert(atomic_load(&ts->pending) != NULL);
+  pthread_mutex_lock(&ts->lock);
+  gpa_drain_remote_frees(ts);
+  pthread_mutex_unlock(&ts->lock);
+  assert(atomic_load(&ts->pending) == NULL);
+  int own_class = gpa_size_class(sizeof(ThreadSafeGPA));
+  for (int i = 0; i < GPA_CLASSES; i++) {
+    // nothing is live but the allocator's own slot
+    size_t live = 0;
+    for (GPABucket *b = ts->central.buckets[i]; b != NULL; b = b->prev) {
+      live += b->live;
+    }
+    assert(live == (i == own_class));
+  }
+
+  // freeing from another thread never takes the lock, this would deadlock
+  MemoryBlock produced[100];
+  for (int i = 0; i < 100; i++) {
+    produced[i] = allocator->vtable->alloc(allocator, 64, DEFAULT_ALIGN);
+  }
+  GPABucket *produced_bucket = gpa_bucket_of(produced[0].ptr);
+  size_t produced_live = produced_bucket->live;
+  pthread_mutex_lock(&ts->lock);
+  GPATestWorker consumer = {allocator, 0, produced, 100};
+  pthread_t consumer_thread;
+  pthread_create(&consumer_thread, NULL, gpa_test_consumer, &consumer);
+  pthread_join(consumer_thread, NULL);
+  assert(produced_bucket->live == produced_live); // deferred until a refill
+  assert(atomic_load(&produced_bucket->remote_free) != NULL);
+  pthread_mutex_unlock(&ts->lock);
+
+  // the next refill drains it
+  cache = gpa_thread_cache(ts);
+  int class64 = gpa_size_class(64);
+  gpa_cache_flush(cache, class64, cache->count[class64]); // force a refill
+  MemoryBlock str3 = allocator->vtable->alloc(allocator, 64, DEFAULT_ALIGN);
+  assert(str3.ptr != NULL);
+  assert(atomic_load(&ts->pending) == NULL);
+
+  // a destroyed allocator gives its thread key back, more of them than
+  // PTHREAD_KEYS_MAX (1024 on glibc) can come and go
+  for (int i = 0; i < 2000; i++) {
+    Allocator *temp = create_thread_safe_gpa_allocator();
+    assert(temp != NULL);
+    MemoryBlock block = temp->vtable->alloc(temp, 64, DEFAULT_ALIGN);
+    temp->vtable->free(temp, block);
+    destroy_thread_safe_gpa_allocator(temp);
+  }
+
+  printf("all thread-safe gpa allocator tests passed\n");
+}
+
+// c allocator: libc malloc behind the vtable, like zig's std.heap.c_allocator.
+// LD_PRELOAD jemalloc or mimalloc to get those instead
+static MemoryBlock c_alloc(Allocator *self, size_t size, uint8_t log2_align) {
+  (void)self;
+  size_t alignment = (size_t)1 << log2_align;
+  void *ptr = NULL;
+  if (alignment <= _Alignof(max_align_t))
+    ptr = malloc(size);
+  else if (posix_memalign(&ptr, alignment, size) != 0)
+    ptr = NULL;
+  if (ptr == NULL)
+    return (MemoryBlock){NULL, 0};
+  return (MemoryBlock){ptr, size};
+}
+
+static void c_free(Allocator *self, MemoryBlock memory) {
+  (void)self;
+  free(memory.ptr);
+}
+
+static bool c_resize(Allocator *self, MemoryBlock *memory, uint8_t log2_align,
+                     size_t new_size) {
+  (void)self;
+  (void)log2_align;
+  if (new_size > malloc_usable_size(memory->ptr))
+    return false;
+  memory->size = new_size;
+  return true;
+}
+
+// realloc only keeps malloc's own alignment, anything above it is copied
+static MemoryBlock c_remap(Allocator *self, MemoryBlock memory,
+                           uint8_t log2_align, size_t new_size) {
+  if (c_resize(self, &memory, log2_align, new_size))
+    return memory;
+  if (((size_t)1 << log2_align) > _Alignof(max_align_t)) {
+    MemoryBlock moved = c_alloc(self, new_size, log2_align);
+    if (moved.ptr == NULL)
+      return moved;
+    size_t keep = memory.size < new_size ? memory.size : new_size;
+    memcpy(moved.ptr, memory.ptr, keep);
+    free(memory.ptr);
+    return moved;
+  }
+
+  // a failed realloc leaves the old block alone
+  void *ptr = realloc(memory.ptr, new_size);
+  if (ptr == NULL)
+    return (MemoryBlock){NULL, 0};
+  return (MemoryBlock){ptr, new_size};
+}
+
+// calloc knows which of its chunks came straight from mmap, there's no
+// aligned calloc to ask for the rest
+static MemoryBlock c_alloc_zeroed(Allocator *self, size_t size,
+                                  uint8_t log2_align) {
+  if (((size_t)1 << log2_align) > _Alignof(max_align_t))
+    return generic_alloc_zeroed(self, size, log2_align);
+  void *ptr = calloc(1, size);
+  if (ptr == NULL)
+    return (MemoryBlock){NULL, 0};
+  return (MemoryBlock){ptr, size};
+}
+
+// malloc keeps its own books, only the syscall counts are ours
+static void c_stats(Allocator *self, AllocatorStats *out) {
+  (void)self;
+  stats_init(out);
+}
+
+AllocatorVTable c_vtable = {.alloc = c_alloc,
+                            .free = c_free,
+                            .resize = c_resize,
+                            .remap = c_remap,
+                            .stats = c_stats,
+                            .alloc_many = generic_alloc_many,
+                            .free_many = generic_free_many,
+                            .alloc_zeroed = c_alloc_zeroed};
+
+static Allocator c_allocator = {&c_vtable};
+
+Allocator *create_c_allocator() { return &c_allocator; }
+
+void test_c_allocator(Allocator *allocator) {
+  MemoryBlock str1 = allocator->vtable->alloc(allocator, 20, DEFAULT_ALIGN);
+  assert(str1.size == 20);
+  memcpy(str1.ptr, "malloc'd\0", 9);
+
+  // resize only within what malloc really handed out
+  size_t usable = malloc_usable_size(str1.ptr);
+  assert(allocator->vtable->resize(allocator, &str1, DEFAULT_ALIGN, usable));
+  assert(!allocator->vtable->resize(allocator, &str1, DEFAULT_ALIGN, 1 << 20));
+  str1 = allocator->vtable->remap(allocator, str1, DEFAULT_ALIGN, 1 << 20);
+  assert(str1.size == 1 << 20);
+  assert(strcmp(str1.ptr, "malloc'd") == 0);
+  allocator->vtable->free(allocator, str1);
+
+  MemoryBlock aligned = allocator->vtable->alloc(allocator, 100, 12);
+  assert((uintptr_t)aligned.ptr % 4096 == 0);
+  memcpy(aligned.ptr, "aligned\0", 8);
+  aligned = allocator->vtable->remap(allocator, aligned, 12, 100000);
+  assert((uintptr_t)aligned.ptr % 4096 == 0);
+  assert(strcmp(aligned.ptr, "aligned") == 0);
+  allocator->vtable->free(allocator, aligned);
+
+  printf("all c allocator tests passed\n");
+}
+
+// stack fallback allocator: like zig's std.heap.stackFallback. blocks come
+// out of a caller's buffer, usually on the stack, until it is full and then
+// from the fallback. free and resize go wherever the block's address says
+typedef struct {
+  Allocator base;
+  FixedBufferAllocator *fba; // sits at the start of the buffer
+  Allocator *fallback;
+} StackFallbackAllocator;
+
+static inline bool stack_fallback_owns(StackFallbackAllocator *sfa,
+                                       void *ptr) {
+  char *start = (char *)sfa->fba;
+  return (char *)ptr >= start && (char *)ptr < start + sfa->fba->size;
+}
+
+static MemoryBlock stack_fallback_alloc(Allocator *self, size_t size,
+                                        uint8_t log2_align) {
+  StackFallbackAllocator *sfa = (StackFallbackAllocator *)self;
+  MemoryBlock block = fba_alloc_inline(sfa->fba, size, log2_align);
+  if (block.ptr != NULL)
+    return block;
+  return sfa->fallback->vtable->alloc(sfa->fallback, size, log2_align);
+}
+
+static MemoryBlock stack_fallback_alloc_zeroed(Allocator *self, size_t size,
+                                               uint8_t log2_align) {
+  StackFallbackAllocator *sfa = (StackFallbackAllocator *)self;
+  MemoryBlock block = fba_alloc_inline(sfa->fba, size, log2_align);
+  if (block.ptr != NULL) {
+    memset(block.ptr, 0, block.size);
+    return block;
+  }
+  return sfa->fallback->vtable->alloc_zeroed(sfa->fallback, size, log2_align);
+}
+
+static void stack_fallback_free(Allocator *self, MemoryBlock memory) {
+  StackFallbackAllocator *sfa = (StackFallbackAllocator *)self;
+  if (!stack_fallback_owns(sfa, memory.ptr))
+    sfa->fallback->vtable->free(sfa->fallback, memory);
+}
+
+static bool stack_fallback_resize(Allocator *self, MemoryBlock *memory,
+                                  uint8_t log2_align, size_t new_size) {
+  StackFallbackAllocator *sfa = (StackFallbackAllocator *)self;
+  if (stack_fallback_owns(sfa, memory->ptr))
+    return fixed_buffer_resize(&sfa->fba->base, memory, log2_align, new_size);
+  return sfa->fallback->vtable->resize(sfa->fallback, memory, log2_align,
+                                       new_size);
+}
+
+// a buffer block that can't grow in place moves, to the fallback once the
+// buffer is full
+static MemoryBlock stack_fallback_remap(Allocator *self, MemoryBlock memory,
+                                        uint8_t log2_align, size_t new_size) {
+  StackFallbackAllocator *sfa = (StackFallbackAllocator *)self;
+  if (!stack_fallback_owns(sfa, memory.ptr))
+    return sfa->fallback->vtable->remap(sfa->fallback, memory, log2_align,
+                                        new_size);
+  return bump_remap(self, memory, log2_align, new_size);
+}
+
+// the fallback's numbers, with the buffer's counters added in
+static void stack_fallback_stats(Allocator *self, AllocatorStats *out) {
+  StackFallbackAllocator *sfa = (StackFallbackAllocator *)self;
+  sfa->fallback->vtable->stats(sfa->fallback, out);
+#if ZALLOC_STATS
+  AllocatorCounters *buffer = &sfa->fba->counters;
+  out->counters.live_bytes += buffer->live_bytes;
+  out->counters.peak_bytes += buffer->peak_bytes;
+  out->counters.requested_bytes += buffer->requested_bytes;
+  out->counters.rounded_bytes += buffer->rounded_bytes;
+  out->counters.allocs += buffer->allocs;
+  out->counters.frees += buffer->frees;
+#endif
+}
+
+AllocatorVTable stack_fallback_vtable = {.alloc = stack_fallback_alloc,
+                                         .free = stack_fallback_free,
+                                         .resize = stack_fallback_resize,
+                                         .remap = stack_fallback_remap,
+                                         .stats = stack_fallback_stats,
+                                         .alloc_many = generic_alloc_many,
+                                         .free_many = generic_free_many,
+                                         .alloc_zeroed =
+                                             stack_fallback_alloc_zeroed};
+
+// sfa and buffer usually both live in the caller's frame:
+//   char buf[4096];
+//   StackFallbackAllocator sfa;
+//   Allocator *scratch = init_stack_fallback_allocator(&sfa, buf, 4096, gpa);
+Allocator *init_stack_fallback_allocator(StackFallbackAllocator *sfa,
+                                         void *buffer, size_t size,
+                                         Allocator *fallback) {
+  sfa->base.vtable = &stack_fallback_vtable;
+  sfa->fba = (FixedBufferAllocator *)create_fixed_buffer_allocator(buffer, size);
+  sfa->fallback = fallback;
+  return (Allocator *)sfa;
+}
+
+void test_stack_fallback(Allocator *gpa) {
+  _Alignas(16) char buf[256];
+  StackFallbackAllocator sfa;
+  Allocator *allocator =
+      init_stack_fallback_allocator(&sfa, buf, sizeof(buf), gpa);
+
+  // small blocks stay in the buffer
+  MemoryBlock str1 = allocator->vtable->alloc(allocator, 100, DEFAULT_ALIGN);
+  assert(stack_fallback_owns(&sfa, str1.ptr));
+  memcpy(str1.ptr, "on the stack\0", 13);
+
+  // a full buffer spills over instead of exiting
+  MemoryBlock str2 = allocator->vtable->alloc(allocator, 200, DEFAULT_ALIGN);
+  assert(!stack_fallback_owns(&sfa, str2.ptr));
+  MemoryBlock str3 = allocator->vtable->alloc(allocator, 50, DEFAULT_ALIGN);
+  assert(stack_fallback_owns(&sfa, str3.ptr)); // what's left still gets used
+
+  // resize goes by address
+  assert(allocator->vtable->resize(allocator, &str3, DEFAULT_ALIGN, 80));
+  assert(!allocator->vtable->resize(allocator, &str3, DEFAULT_ALIGN, 200));
+  assert(allocator->vtable->resize(allocator, &str2, DEFAULT_ALIGN,
+                                   gpa_usable_size(str2)));
+
+  // outgrowing the buffer moves the block to the fallback, data and all
+  str1 = allocator->vtable->remap(allocator, str1, DEFAULT_ALIGN, 1000);
+  assert(!stack_fallback_owns(&sfa, str1.ptr));
+  assert(strcmp(str1.ptr, "on the stack") == 0);
+
+  allocator->vtable->free(allocator, str1);
+  allocator->vtable->free(allocator, str2);
+  allocator->vtable->free(allocator, str3);
+  printf("all stack fallback allocator tests passed\n");
+}
+
+// profiling allocator: wraps any allocator and records the stack of about one
+// allocation per sample_period bytes, like tcmalloc's heap sampler. samples
+// go into a lock-free ring, the newest PROFILE_RING of them are kept, and
+// profiling_allocator_dump writes them as a pprof legacy heap profile
+#define PROFILE_MAX_FRAMES 32
+#define PROFILE_RING 4096
+
+typedef struct {
+  _Atomic size_t seq; // ticket + 1 once written, 0 while being written
+  size_t size;
+  int depth;
+  void *frames[PROFILE_MAX_FRAMES];
+} ProfileSample;
+
+typedef struct {
+  Allocator base;
+  Allocator *child;
+  size_t sample_period;
+  _Atomic size_t head; // tickets handed out so far
+  ProfileSample ring[PROFILE_RING];
+} ProfilingAllocator;
+
+// per thread, shared by every profiler like tcmalloc's
+static _Thread_local uint64_t profile_rng;
+static _Thread_local intptr_t profile_countdown; // bytes to the next sample
+
+// exponentially distributed around period, so every byte is equally likely
+// to be sampled, which is what pprof's heap_v2 unsampling assumes.
+// -ln(r / 2^32) = (32 - log2(r)) * ln 2, with log2 linear between powers of 2
+static intptr_t profile_next_sample(size_t period) {
+  profile_rng ^= profile_rng << 13;
+  profile_rng ^= profile_rng >> 7;
+  profile_rng ^= profile_rng << 17;
+  uint32_t r = (uint32_t)(profile_rng >> 32) | 1;
+  int whole = log2_floor(r);
+  double log2_r = whole + ((double)r / ((uint64_t)1 << whole) - 1.0);
+  return (intptr_t)((32.0 - log2_r) * 0.6931471805599453 * period) + 1;
+}
+
+// not inlined so the two frames to skip are always this one and the caller
+__attribute__((noinline)) static void profile_sample(ProfilingAllocator *p,
+                                                     size_t size) {
+  if (profile_rng == 0) {
+    // first allocation on this thread, start counting down from here
+    profile_rng = ((uintptr_t)&size ^ ((uint64_t)time(NULL) << 32)) | 1;
+    profile_countdown += profile_next_sample(p->sample_period);
+    if (profile_countdown > 0)
+      return;
+  }
+  profile_countdown = profile_next_sample(p->sample_period);
+
+  void *frames[PROFILE_MAX_FRAMES + 2];
+  int depth = backtrace(frames, PROFILE_MAX_FRAMES + 2) - 2;
+  size_t ticket = atomic_fetch_add_explicit(&p->head, 1, memory_order_relaxed);
+  ProfileSample *slot = &p->ring[ticket % PROFILE_RING];
+  atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  slot->size = size;
+  slot->depth = depth < 0 ? 0 : depth;
+  memcpy(slot->frames, frames + 2, slot->depth * sizeof(void *));
+  atomic_store_explicit(&slot->seq, ticket + 1, memory_order_release);
+}
+
+static MemoryBlock profiling_alloc(Allocator *self, size_t size,
+                                   uint8_t log2_align) {
+  ProfilingAllocator *p = (ProfilingAllocator *)self;
+  MemoryBlock block = p->child->vtable->alloc(p->child, size, log2_align);
+  if (block.ptr == NULL)
+    return block;
+  if ((profile_countdown -= (intptr_t)size) <= 0)
+    profile_sample(p, size);
+  return block;
+}
+
+static MemoryBlock profiling_alloc_zeroed(Allocator *self, size_t size,
+                                          uint8_t log2_align) {
+  ProfilingAllocator *p = (ProfilingAllocator *)self;
+  MemoryBlock block =
+      p->child->vtable->alloc_zeroed(p->child, size, log2_align);
+  if (block.ptr == NULL)
+    return block;
+  if ((profile_countdown -= (intptr_t)size) <= 0)
+    profile_sample(p, size);
+  return block;
+}
+
+static void profiling_free(Allocator *self, MemoryBlock memory) {
+  ProfilingAllocator *p = (ProfilingAllocator *)self;
+  p->child->vtable->free(p->child, memory);
+}
+
+static bool profiling_resize(Allocator *self, MemoryBlock *memory,
+                             uint8_t log2_align, size_t new_size) {
+  ProfilingAllocator *p = (ProfilingAllocator *)self;
+  return p->child->vtable->resize(p->child, memory, log2_align, new_size);
+}
+
+// growth counts towards the next sample like a fresh allocation would
+static MemoryBlock profiling_remap(Allocator *self, MemoryBlock memory,
+                                   uint8_t log2_align, size_t new_size) {
+  ProfilingAllocator *p = (ProfilingAllocator *)self;
+  size_t old_size = memory.size;
+  memory = p->child->vtable->remap(p->child, memory, log2_align, new_size);
+  if (memory.ptr != NULL && new_size > old_size &&
+      (profile_countdown -= (intptr_t)(new_size - old_size)) <= 0)
+    profile_sample(p, new_size);
+  return memory;
+}
+
+static void profiling_stats(Allocator *self, AllocatorStats *out) {
+  ProfilingAllocator *p = (ProfilingAllocator *)self;
+  p->child->vtable->stats(p->child, out);
+}
+
+AllocatorVTable profiling_vtable = {.alloc = profiling_alloc,
+                                    .free = profiling_free,
+                                    .resize = profiling_resize,
+                                    .remap = profiling_remap,
+                                    .stats = profiling_stats,
+                                    .alloc_many = generic_alloc_many,
+                                    .free_many = generic_free_many,
+                                    .alloc_zeroed = profiling_alloc_zeroed};
+
+Allocator *create_profiling_allocator(Allocator *child, size_t sample_period) {
+  ProfilingAllocator *p = new_page_memory(sizeof(ProfilingAllocator));
+  if (p == NULL)
+    return NULL;
+  p->base.vtable = &profiling_vtable;
+  p->child = child;
+  p->sample_period = sample_period;
+  atomic_init(&p->head, 0);
+  for (int i = 0; i < PROFILE_RING; i++) {
+    atomic_init(&p->ring[i].seq, 0);
+  }
+  // the first backtrace may dlopen the unwinder, get it out of the way
+  void *frames[1];
+  backtrace(frames, 1);
+  return (Allocator *)p;
+}
+
+static int profile_compare(const void *a, const void *b) {
+  const ProfileSample *x = a, *y = b;
+  if (x->depth != y->depth)
+    return x->depth - y->depth;
+  return memcmp(x->frames, y->frames, x->depth * sizeof(void *));
+}
+
+// legacy text format: one "count: bytes [count: bytes] @ pc..." line per
+// stack, then the mappings so pprof can symbolize. frees aren't tracked, so
+// in-use and allocated are the same numbers: this is an allocation profile.
+// samples still being written while this runs are skipped
+void profiling_allocator_dump(Allocator *allocator, FILE *out) {
+  ProfilingAllocator *p = (ProfilingAllocator *)allocator;
+  ProfileSample *samples = new_page_memory(sizeof(p->ring));
+  if (samples == NULL)
+    return;
+  size_t count = 0;
+  for (int i = 0; i < PROFILE_RING; i++) {
+    ProfileSample *slot = &p->ring[i];
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (seq == 0)
+      continue;
+    samples[count].size = slot->size;
+    samples[count].depth = slot->depth;
+    memcpy(samples[count].frames, slot->frames, sizeof(slot->frames));
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq)
+      count++;
+  }
+  qsort(samples, count, sizeof(ProfileSample), profile_compare);
+
+  size_t total_bytes = 0;
+  for (size_t i = 0; i < count; i++) {
+    total_bytes += samples[i].size;
+  }
+  fprintf(out, "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n", count,
+          total_bytes, count, total_bytes, p->sample_period);
+  for (size_t i = 0; i < count;) {
+    size_t n = 0, bytes = 0, first = i;
+    for (; i < count && profile_compare(&samples[first], &samples[i]) == 0;
+         i++) {
+      n++;
+      bytes += samples[i].size;
+    }
+    fprintf(out, "%zu: %zu [%zu: %zu] @", n, bytes, n, bytes);
+    for (int f = 0; f < samples[first].depth; f++) {
+      fprintf(out, " %p", samples[first].frames[f]);
+    }
+    fprintf(out, "\n");
+  }
+
+  fprintf(out, "\nMAPPED_LIBRARIES:\n");
+  FILE *maps = fopen("/proc/self/maps", "r");
+  if (maps != NULL) {
+    char line[512];
+    while (fgets(line, sizeof(line), maps) != NULL) {
+      fputs(line, out);
+    }
+    fclose(maps);
+  }
+  free_page_memory(samples, sizeof(p->ring));
+}
+
+__attribute__((noinline)) static MemoryBlock
+profiled_call_site(Allocator *allocator) {
+  return allocator->vtable->alloc(allocator, 64, DEFAULT_ALIGN);
+}
+
+void test_profiling(Allocator *allocator) {
+  // a period of one byte samples every allocation
+  Allocator *profiler = create_profiling_allocator(allocator, 1);
+  MemoryBlock blocks[100];
+  for (int i = 0; i < 100; i++) {
+    blocks[i] = profiled_call_site(profiler);
+  }
+  for (int i = 0; i < 100; i++) {
+    profiler->vtable->free(profiler, blocks[i]);
+  }
+
+  FILE *out = tmpfile();
+  profiling_allocator_dump(profiler, out);
+  size_t length = ftell(out);
+  rewind(out);
+  char *text = new_page_memory(length + 1);
+  size_t read = fread(text, 1, length, out);
+  assert(read == length);
+  text[read] = '\0';
+  fclose(out);
+
+  // one call site, so one stack holding all of them
+  assert(strncmp(text, "heap profile: ", 14) == 0);
+  assert(strstr(text, "@ heap_v2/1\n") != NULL);
+  assert(strstr(text, "100: 6400 [100: 6400] @ 0x") != NULL);
+  assert(strstr(text, "\nMAPPED_LIBRARIES:\n") != NULL);
+  free_page_memory(text, length + 1);
+
+  printf("all profiling allocator tests passed\n");
+}
+
+// debug allocator: wraps any allocator that frees blocks one by one and
+// checks how it is used, like zig's DebugAllocator. live blocks sit in an
+// open-addressing table, so a double free, a free of a block that was never
+// handed out or a free with the wrong size aborts with a message, and
+// debug_allocator_deinit reports what is still live with its size and call
+// site. one lock and one probe per call, cheap enough to leave on in canaries.
+// with guard_pages every block gets a mapping of its own instead of the
+// child's memory. it ends right at a PROT_NONE page, so an overflow faults
+// on the spot, and a freed block's pages stay PROT_NONE for a while so a use
+// after free faults too
+#define DEBUG_TABLE_MIN 1024 // entries, a power of two
+#define DEBUG_QUARANTINE 256 // freed guarded mappings kept inaccessible
+
+typedef struct {
+  void *ptr; // NULL when the slot is empty
+  size_t size;
+  void *site; // return address of the alloc
+} DebugEntry;
+
+typedef struct {
+  void *ptr;
+  size_t size;
+} DebugMapping;
+
+typedef struct {
+  Allocator base;
+  Allocator *child;
+  bool guard_pages;
+  pthread_mutex_t lock;
+  DebugEntry *table;
+  size_t capacity; // kept under 3/4 full
+  size_t count;
+  DebugMapping quarantine[DEBUG_QUARANTINE]; // ring, oldest goes first
+  size_t quarantined;
+} DebugAllocator;
+
+static inline size_t debug_slot(const void *ptr, size_t capacity) {
+  uint64_t hash = (uint64_t)(uintptr_t)ptr * 0x9E3779B97F4A7C15ull;
+  return (size_t)(hash >> 32) & (capacity - 1);
+}
+
+// where ptr is, or the empty slot it would go in
+static size_t debug_find(DebugAllocator *d, const void *ptr) {
+  size_t i = debug_slot(ptr, d->capacity);
+  while (d->table[i].ptr != NULL && d->table[i].ptr != ptr)
+    i = (i + 1) & (d->capacity - 1);
+  return i;
+}
+
+// false if the bigger table can't be had
+static bool debug_reserve(DebugAllocator *d) {
+  if ((d->count + 1) * 4 <= d->capacity * 3)
+    return true;
+  DebugEntry *old = d->table;
+  size_t old_capacity = d->capacity;
+  DebugEntry *table = new_page_memory(old_capacity * 2 * sizeof(DebugEntry));
+  if (table == NULL)
+    return false;
+  memset(table, 0, old_capacity * 2 * sizeof(DebugEntry));
+  d->table = table;
+  d->capacity = old_capacity * 2;
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old[i].ptr != NULL)
+      d->table[debug_find(d, old[i].ptr)] = old[i];
+  }
+  free_page_memory(old, old_capacity * sizeof(DebugEntry));
+  return true;
+}
+
+// aborts if the child handed out a block that is still live
+static void debug_insert(DebugAllocator *d, MemoryBlock block, void *site) {
+  size_t i = debug_find(d, block.ptr);
+  if (d->table[i].ptr != NULL) {
+    fprintf(stderr, "debug allocator: %p handed out twice\n", block.ptr);
+    abort();
+  }
+  d->table[i] = (DebugEntry){block.ptr, block.size, site};
+  d->count++;
+}
+
+// backward shift instead of tombstones, probes never get longer with churn
+static void debug_remove(DebugAllocator *d, size_t i) {
+  size_t mask = d->capacity - 1;
+  for (size_t j = (i + 1) & mask; d->table[j].ptr != NULL; j = (j + 1) & mask) {
+    size_t home = debug_slot(d->table[j].ptr, d->capacity);
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      d->table[i] = d->table[j];
+      i = j;
+    }
+  }
+  d->table[i].ptr = NULL;
+  d->count--;
+}
+
+// the entry for memory, aborts on a block that isn't live or has the wrong
+// size. lock held
+static size_t debug_check(DebugAllocator *d, MemoryBlock memory,
+                          const char *op) {
+  size_t i = debug_find(d, memory.ptr);
+  if (d->table[i].ptr == NULL) {
+    fprintf(stderr, "debug allocator: %s of %p, a double free or a block "
+                    "that was never allocated\n", op, memory.ptr);
+    abort();
+  }
+  if (d->table[i].size != memory.size) {
+    fprintf(stderr, "debug allocator: %s of %p with size %zu, it has %zu\n",
+            op, memory.ptr, memory.size, d->table[i].size);
+    abort();
+  }
+  return i;
+}
+
+// the block ends where the guard page starts, as close as its alignment
+// lets it
+static void *debug_guard_map(size_t size, uint8_t log2_align) {
+  size_t usable = (size + 4095) & ~(size_t)4095;
+  char *start = map_pages(usable + 4096, log2_align);
+  if (start == NULL)
+    return NULL;
+  mprotect(start + usable, 4096, PROT_NONE);
+  size_t alignment = (size_t)1 << log2_align;
+  return start + ((usable - size) & ~(alignment - 1));
+}
+
+// the mapping behind a guarded block always starts in the block's first page
+static DebugMapping debug_guard_mapping(MemoryBlock memory) {
+  void *start = (void *)((uintptr_t)memory.ptr & ~(uintptr_t)4095);
+  size_t usable = ((char *)memory.ptr + memory.size - (char *)start + 4095) &
+                  ~(size_t)4095;
+  return (DebugMapping){start, usable + 4096};
+}
+
+// the pages go back to the kernel but the range stays reserved, reads and
+// writes to it fault until it drops out of the quarantine. lock held
+static void debug_guard_free(DebugAllocator *d, MemoryBlock memory) {
+  DebugMapping mapping = debug_guard_mapping(memory);
+  STAT_SYSCALL(madvises);
+  madvise(mapping.ptr, mapping.size, MADV_DONTNEED);
+  mprotect(mapping.ptr, mapping.size, PROT_NONE);
+  DebugMapping *slot = &d->quarantine[d->quarantined++ % DEBUG_QUARANTINE];
+  if (slot->ptr != NULL) {
+    STAT_SYSCALL(munmaps);
+    munmap(slot->ptr, slot->size);
+  }
+  *slot = mapping;
+}
+
+static MemoryBlock debug_alloc_block(DebugAllocator *d, size_t size,
+                                     uint8_t log2_align, bool zeroed,
+                                     void *site) {
+  MemoryBlock block;
+  if (!d->guard_pages) {
+    block = zeroed ? d->child->vtable->alloc_zeroed(d->child, size, log2_align)
+                   : d->child->vtable->alloc(d->child, size, log2_align);
+  } else if (size == 0 || size > ALLOC_SIZE_MAX) {
+    block = (MemoryBlock){NULL, 0};
+  } else {
+    block = (MemoryBlock){debug_guard_map(size, log2_align), size};
+    if (block.ptr != NULL && !zeroed)
+      poison(block.ptr, size);
+  }
+  if (block.ptr == NULL)
+    return (MemoryBlock){NULL, 0};
+
+  pthread_mutex_lock(&d->lock);
+  bool reserved = debug_reserve(d);
+  if (reserved)
+    debug_insert(d, block, site);
+  pthread_mutex_unlock(&d->lock);
+  if (!reserved) {
+    if (d->guard_pages) {
+      DebugMapping mapping = debug_guard_mapping(block);
+      munmap(mapping.ptr, mapping.size);
+    } else {
+      d->child->vtable->free(d->child, block);
+    }
+    return (MemoryBlock){NULL, 0};
+  }
+  return block;
+}
+
+static MemoryBlock debug_alloc(Allocator *self, size_t size,
+                               uint8_t log2_align) {
+  return debug_alloc_block((DebugAllocator *)self, size, log2_align, false,
+                           __builtin_return_address(0));
+}
+
+static MemoryBlock debug_alloc_zeroed(Allocator *self, size_t size,
+                                      uint8_t log2_align) {
+  return debug_alloc_block((DebugAllocator *)self, size, log2_align, true,
+                           __builtin_return_address(0));
+}
+
+static void debug_free(Allocator *self, MemoryBlock memory) {
+  DebugAllocator *d = (DebugAllocator *)self;
+  pthread_mutex_lock(&d->lock);
+  debug_remove(d, debug_check(d, memory, "free"));
+  if (d->guard_pages) {
+    debug_guard_free(d, memory);
+    pthread_mutex_unlock(&d->lock);
+    return;
+  }
+  pthread_mutex_unlock(&d->lock);
+  d->child->vtable->free(d->child, memory);
+}
+
+// a guarded block sits against its guard page, it can't change size
+static bool debug_resize(Allocator *self, MemoryBlock *memory,
+                         uint8_t log2_align, size_t new_size) {
+  DebugAllocator *d = (DebugAllocator *)self;
+  pthread_mutex_lock(&d->lock);
+  size_t i = debug_check(d, *memory, "resize");
+  bool resized = d->guard_pages
+                     ? new_size == memory->size
+                     : d->child->vtable->resize(d->child, memory, log2_align,
+                                                new_size);
+  if (resized)
+    d->table[i].size = memory->size;
+  pthread_mutex_unlock(&d->lock);
+  return resized;
+}
+
+static MemoryBlock debug_remap(Allocator *self, MemoryBlock memory,
+                               uint8_t log2_align, size_t new_size) {
+  DebugAllocator *d = (DebugAllocator *)self;
+  if (d->guard_pages) {
+    pthread_mutex_lock(&d->lock);
+    void *site = d->table[debug_check(d, memory, "remap")].site;
+    pthread_mutex_unlock(&d->lock);
+    MemoryBlock moved =
+        debug_alloc_block(d, new_size, log2_align, false, site);
+    if (moved.ptr == NULL)
+      return moved;
+    memcpy(moved.ptr, memory.ptr,
+           memory.size < new_size ? memory.size : new_size);
+    debug_free(self, memory);
+    return moved;
+  }
+
+  // the old entry makes room for the new one, no growing needed
+  pthread_mutex_lock(&d->lock);
+  size_t i = debug_check(d, memory, "remap");
+  void *site = d->table[i].site;
+  MemoryBlock moved =
+      d->child->vtable->remap(d->child, memory, log2_align, new_size);
+  if (moved.ptr != NULL) {
+    debug_remove(d, i);
+    debug_insert(d, moved, site);
+  }
+  pthread_mutex_unlock(&d->lock);
+  return moved;
+}
+
+static void debug_stats(Allocator *self, AllocatorStats *out) {
+  DebugAllocator *d = (DebugAllocator *)self;
+  d->child->vtable->stats(d->child, out);
+}
+
+AllocatorVTable debug_vtable = {.alloc = debug_alloc,
+                                .free = debug_free,
+                                .resize = debug_resize,
+                                .remap = debug_remap,
+                                .stats = debug_stats,
+                                .alloc_many = generic_alloc_many,
+                                .free_many = generic_free_many,
+                                .alloc_zeroed = debug_alloc_zeroed};
+
+// NULL if the table can't be mapped
+Allocator *create_debug_allocator(Allocator *child, bool guard_pages) {
+  DebugAllocator *d = new_page_memory(sizeof(DebugAllocator));
+  if (d == NULL)
+    return NULL;
+  d->table = new_page_memory(DEBUG_TABLE_MIN * sizeof(DebugEntry));
+  if (d->table == NULL) {
+    free_page_memory(d, sizeof(DebugAllocator));
+    return NULL;
+  }
+  memset(d->table, 0, DEBUG_TABLE_MIN * sizeof(DebugEntry));
+  d->base.vtable = &debug_vtable;
+  d->child = child;
+  d->guard_pages = guard_pages;
+  pthread_mutex_init(&d->lock, NULL);
+  d->capacity = DEBUG_TABLE_MIN;
+  d->count = 0;
+  memset(d->quarantine, 0, sizeof(d->quarantine));
+  d->quarantined = 0;
+  return (Allocator *)d;
+}
+
+// writes a line per leaked block to out and returns how many there were,
+// then lets go of the debug allocator. leaked blocks are left where they are
+size_t debug_allocator_deinit(Allocator *allocator, FILE *out) {
+  DebugAllocator *d = (DebugAllocator *)allocator;
+  size_t leaks = d->count, bytes = 0;
+  for (size_t i = 0; i < d->capacity; i++) {
+    DebugEntry *entry = &d->table[i];
+    if (entry->ptr == NULL)
+      continue;
+    bytes += entry->size;
+    char **symbols = backtrace_symbols(&entry->site, 1);
+    fprintf(out, "leak: %zu bytes at %p, allocated at %s\n", entry->size,
+            entry->ptr, symbols != NULL ? symbols[0] : "?");
+    free(symbols);
+  }
+  if (leaks != 0)
+    fprintf(out, "%zu leaks, %zu bytes\n", leaks, bytes);
+
+  for (size_t i = 0; i < DEBUG_QUARANTINE; i++) {
+    if (d->quarantine[i].ptr != NULL)
+      munmap(d->quarantine[i].ptr, d->quarantine[i].size);
+  }
+  pthread_mutex_destroy(&d->lock);
+  free_page_memory(d->table, d->capacity * sizeof(DebugEntry));
+  free_page_memory(d, sizeof(DebugAllocator));
+  return leaks;
+}
+
+// runs bad in a child process and checks it died instead of exiting cleanly
+static bool debug_dies(void (*bad)(void *), void *arg) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    freopen("/dev/null", "w", stderr); // the report, or a sanitizer's
+    bad(arg);
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+static void debug_double_free(void *arg) {
+  Allocator *debug = arg;
+  MemoryBlock block = debug->vtable->alloc(debug, 32, DEFAULT_ALIGN);
+  debug->vtable->free(debug, block);
+  debug->vtable->free(debug, block);
+}
+
+static void debug_wrong_size(void *arg) {
+  Allocator *debug = arg;
+  MemoryBlock block = debug->vtable->alloc(debug, 32, DEFAULT_ALIGN);
+  block.size = 16;
+  debug->vtable->free(debug, block);
+}
+
+static void debug_overflow(void *arg) {
+  MemoryBlock *block = arg;
+  ((volatile char *)block->ptr)[block->size] = 1;
+}
+
+static void debug_use_after_free(void *arg) {
+  MemoryBlock *block = arg;
+  ((volatile char *)block->ptr)[0] = 1;
+}
+
+void test_debug_allocator(Allocator *allocator) {
+  // every live block is tracked through resize, remap and batches
+  Allocator *debug = create_debug_allocator(allocator, false);
+  DebugAllocator *d = (DebugAllocator *)debug;
+  MemoryBlock a = debug->vtable->alloc(debug, 40, DEFAULT_ALIGN);
+  MemoryBlock b = debug->vtable->alloc_zeroed(debug, 100, DEFAULT_ALIGN);
+  assert(d->count == 2 && ((char *)b.ptr)[99] == 0);
+  assert(debug->vtable->resize(debug, &a, DEFAULT_ALIGN, 32));
+  a = debug->vtable->remap(debug, a, DEFAULT_ALIGN, 5000);
+  assert(a.ptr != NULL && a.size == 5000 && d->count == 2);
+  debug->vtable->free(debug, a);
+  void *ptrs[3000];
+  size_t size = debug->vtable->alloc_many(debug, 24, DEFAULT_ALIGN, ptrs, 3000);
+  assert(size == 24 && d->count == 3001 && d->capacity > DEBUG_TABLE_MIN);
+  for (int i = 0; i < 3000; i += 2) {
+    debug->vtable->free(debug, (MemoryBlock){ptrs[i], size});
+  }
+  for (int i = 1; i < 3000; i += 2) {
+    debug->vtable->free(debug, (MemoryBlock){ptrs[i], size});
+  }
+  assert(d->count == 1);
+
+  // misuse aborts
+  assert(debug_dies(debug_double_free, debug));
+  assert(debug_dies(debug_wrong_size, debug));
+
+  // what is left over is reported with its size and call site
+  FILE *out = tmpfile();
+  assert(debug_allocator_deinit(debug, out) == 1);
+  size_t length = ftell(out);
+  rewind(out);
+  char text[512] = {0};
+  size_t read = fread(text, 1, sizeof(text) - 1, out);
+  assert(read == length);
+  fclose(out);
+  char expected[64];
+  snprintf(expected, sizeof(expected), "leak: %zu bytes at %p, allocated at ",
+           b.size, b.ptr);
+  assert(strncmp(text, expected, strlen(expected)) == 0);
+  snprintf(expected, sizeof(expected), "\n1 leaks, %zu bytes\n", b.size);
+  assert(strstr(text, expected) != NULL);
+  allocator->vtable->free(allocator, b);
+
+  // guarded blocks end at a PROT_NONE page and fault after they are freed
+  Allocator *guarded = create_debug_allocator(allocator, true);
+  MemoryBlock g = guarded->vtable->alloc(guarded, 128, DEFAULT_ALIGN);
+  assert(((uintptr_t)g.ptr + g.size) % 4096 == 0);
+  memset(g.ptr, 1, g.size);
+  assert(debug_dies(debug_overflow, &g));
+  MemoryBlock aligned = guarded->vtable->alloc(guarded, 100, 6);
+  assert((uintptr_t)aligned.ptr % 64 == 0);
+  assert(4096 - ((uintptr_t)aligned.ptr + aligned.size) % 4096 < 64);
+  MemoryBlock moved = guarded->vtable->remap(guarded, g, DEFAULT_ALIGN, 9000);
+  assert(((char *)moved.ptr)[127] == 1);
+  assert(debug_dies(debug_use_after_free, &g));
+  guarded->vtable->free(guarded, moved);
+  guarded->vtable->free(guarded, aligned);
+  assert(debug_allocator_deinit(guarded, stderr) == 0);
+
+  printf("all debug allocator tests passed\n");
+}
+
+void test_alloc_many(void) {
+  void *ptrs[600];
+
+  // a bump allocator cuts the run out of one block
+  Allocator *arena = create_arena_allocator();
+  size_t stride = arena->vtable->alloc_many(arena, 20, 4, ptrs, 100);
+  assert(stride == 32);
+  for (int i = 0; i < 100; i++) {
+    assert((uintptr_t)ptrs[i] % 16 == 0);
+    assert(ptrs[i] == (char *)ptrs[0] + i * 32);
+  }
+  arena->vtable->free_many(arena, 20, ptrs, 100);
+
+  char buffer[1024];
+  Allocator *fba = create_fixed_buffer_allocator(buffer, sizeof(buffer));
+  stride = fba->vtable->alloc_many(fba, 8, DEFAULT_ALIGN, ptrs, 10);
+  assert(stride == 8);
+  assert(ptrs[9] == (char *)ptrs[0] + 72);
+
+  // a fresh gpa bumps whole pages, 256 slots of 16 each
+  Allocator *gpa = create_gpa_allocator();
+#if ZALLOC_STATS
+  AllocatorStats before, after; // the gpa's own slot is live from the start
+  gpa->vtable->stats(gpa, &before);
+#endif
+  size_t slot = gpa->vtable->alloc_many(gpa, 16, DEFAULT_ALIGN, ptrs, 600);
+  assert(slot == 16);
+  for (int i = 1; i < 256; i++) {
+    assert(ptrs[i] == (char *)ptrs[i - 1] + 16);
+  }
+  for (int i = 0; i < 600; i++) {
+    memset(ptrs[i], i, 16);
+  }
+  for (int i = 0; i < 600; i++) {
+    assert(((unsigned char *)ptrs[i])[15] == (unsigned char)i);
+  }
+
+  // freed slots come back before any new page
+  void *freed[100];
+  memcpy(freed, ptrs + 300, sizeof(freed));
+  gpa->vtable->free_many(gpa, 16, freed, 100);
+  void *again[100];
+  gpa->vtable->alloc_many(gpa, 10, DEFAULT_ALIGN, again, 100);
+  for (int i = 0; i < 100; i++) {
+    bool found = false;
+    for (int j = 0; j < 100; j++) {
+      found |= again[i] == freed[j];
+    }
+    assert(found);
+  }
+  memcpy(ptrs + 300, again, sizeof(again));
+  gpa->vtable->free_many(gpa, 16, ptrs, 600);
+#if ZALLOC_STATS
+  gpa->vtable->stats(gpa, &after);
+  assert(after.counters.live_bytes == before.counters.live_bytes);
+  assert(after.counters.allocs - before.counters.allocs == 700);
+  assert(after.counters.frees - before.counters.frees == 700);
+#endif
+
+  // large sizes go one by one
+  gpa->vtable->alloc_many(gpa, 10000, DEFAULT_ALIGN, ptrs, 3);
+  assert(ptrs[0] != ptrs[1] && ptrs[1] != ptrs[2]);
+  gpa->vtable->free_many(gpa, 10000, ptrs, 3);
+
+  // the thread-safe gpa empties its cache and then takes the lock once
+  Allocator *ts = create_thread_safe_gpa_allocator();
+  MemoryBlock warm = ts->vtable->alloc(ts, 64, DEFAULT_ALIGN);
+  ts->vtable->free(ts, warm);
+  slot = ts->vtable->alloc_many(ts, 64, DEFAULT_ALIGN, ptrs, 200);
+  assert(slot == 64);
+  for (int i = 0; i < 200; i++) {
+    assert((uintptr_t)ptrs[i] % 64 == 0);
+    memset(ptrs[i], 0, 64);
+  }
+  ts->vtable->free_many(ts, 64, ptrs, 200);
+  destroy_thread_safe_gpa_allocator(ts);
+
+  // the pool splices its free list in and out whole
+  Allocator *pool = create_memory_pool(24, DEFAULT_ALIGN);
+  slot = pool->vtable->alloc_many(pool, 24, DEFAULT_ALIGN, ptrs, 50);
+  assert(slot == 24);
+  pool->vtable->free_many(pool, 24, ptrs, 50);
+  pool->vtable->alloc_many(pool, 24, DEFAULT_ALIGN, again, 60);
+  assert(again[0] == ptrs[0] && again[49] == ptrs[49]);
+  assert(again[50] == (char *)ptrs[49] + 24);
+  memory_pool_deinit(pool);
+
+  // everything else loops over alloc and free
+  Allocator *c = create_c_allocator();
+  slot = c->vtable->alloc_many(c, 40, DEFAULT_ALIGN, ptrs, 5);
+  assert(slot == 40);
+  c->vtable->free_many(c, 40, ptrs, 5);
+
+  printf("all batch allocation tests passed\n");
+}
+
+void test_oom(void) {
+  // a full buffer hands back NULL blocks and keeps serving what still fits
+  char buffer[256]; // the allocator takes its own struct off the top
+  Allocator *fba = create_fixed_buffer_allocator(buffer, sizeof(buffer));
+  MemoryBlock block = fba->vtable->alloc(fba, 1000, DEFAULT_ALIGN);
+  assert(block.ptr == NULL && block.size == 0);
+  block = fba->vtable->alloc(fba, SIZE_MAX, DEFAULT_ALIGN);
+  assert(block.ptr == NULL);
+  block = fba->vtable->alloc(fba, 8, DEFAULT_ALIGN);
+  assert(block.ptr != NULL);
+  void *ptrs[300];
+  size_t stride = fba->vtable->alloc_many(fba, 8, DEFAULT_ALIGN, ptrs, 100);
+  assert(stride == 0);
+
+  // past its limit the arena maps no new chunk, the current one still serves
+  Allocator *arena = create_arena_allocator();
+  arena_set_memory_limit(arena, 0);
+  block = arena->vtable->alloc(arena, 1 << 20, DEFAULT_ALIGN);
+  assert(block.ptr == NULL);
+  block = arena->vtable->alloc(arena, 64, DEFAULT_ALIGN);
+  assert(block.ptr != NULL);
+  block = arena->vtable->alloc(arena, SIZE_MAX / 2, DEFAULT_ALIGN);
+  assert(block.ptr == NULL);
+  arena_set_memory_limit(arena, SIZE_MAX);
+  block = arena->vtable->alloc(arena, 1 << 20, DEFAULT_ALIGN);
+  assert(block.ptr != NULL);
+  arena->vtable->free(arena, block);
+
+  // the gpa counts a page per page of small slots
+  Allocator *allocator = create_gpa_allocator();
+  GeneralPurposeAllocator *gpa = (GeneralPurposeAllocator *)allocator;
+  size_t used = gpa->used_pages;
+  gpa_set_memory_limit(allocator, (used + 1) * 4096);
+  MemoryBlock slots[4];
+  for (int i = 0; i < 4; i++) {
+    slots[i] = allocator->vtable->alloc(allocator, 1024, DEFAULT_ALIGN);
+    assert(slots[i].ptr != NULL);
+  }
+  block = allocator->vtable->alloc(allocator, 1024, DEFAULT_ALIGN);
+  assert(block.ptr == NULL);
+  block = allocator->vtable->alloc(allocator, 8, DEFAULT_ALIGN);
+  assert(block.ptr == NULL); // a new class needs a new page
+  allocator->vtable->free(allocator, slots[1]);
+  slots[1] = allocator->vtable->alloc(allocator, 1024, DEFAULT_ALIGN);
+  assert(slots[1].ptr != NULL);
+  for (int i = 0; i < 4; i++) {
+    allocator->vtable->free(allocator, slots[i]);
+  }
+  assert(gpa->used_pages == used + 1); // the class keeps its last page
+
+  // a batch that doesn't fit gives back the part it got
+  used = gpa->used_pages;
+  gpa_set_memory_limit(allocator, (used + 1) * 4096);
+  stride = allocator->vtable->alloc_many(allocator, 64, DEFAULT_ALIGN, ptrs, 100);
+  assert(stride == 0);
+  stride = allocator->vtable->alloc_many(allocator, 64, DEFAULT_ALIGN, ptrs, 64);
+  assert(stride == 64);
+  assert(gpa->used_pages == used + 1);
+  allocator->vtable->free_many(allocator, 64, ptrs, 64);
+
+  // and so do large blocks, a failed remap keeps the old block
+  gpa_set_memory_limit(allocator, SIZE_MAX);
+  block = allocator->vtable->alloc(allocator, SIZE_MAX / 2, DEFAULT_ALIGN);
+  assert(block.ptr == NULL);
+  block = allocator->vtable->alloc(allocator, 1 << 16, DEFAULT_ALIGN);
+  assert(block.ptr != NULL);
+  memset(block.ptr, 0x5A, block.size);
+  gpa_set_memory_limit(allocator, gpa->used_pages * 4096);
+  MemoryBlock grown =
+      allocator->vtable->remap(allocator, block, DEFAULT_ALIGN, 1 << 20);
+  assert(grown.ptr == NULL);
+  assert(!allocator->vtable->resize(allocator, &block, DEFAULT_ALIGN, 1 << 20));
+  assert(block.size == 1 << 16 && ((char *)block.ptr)[block.size - 1] == 0x5A);
+  MemoryBlock large = allocator->vtable->alloc(allocator, 1 << 16, DEFAULT_ALIGN);
+  assert(large.ptr == NULL);
+  allocator->vtable->free(allocator, block);
+
+  // the thread-safe gpa puts the limit on its central pool
+  Allocator *ts = create_thread_safe_gpa_allocator();
+  gpa_thread_safe_set_memory_limit(ts, 0);
+  block = ts->vtable->alloc(ts, 1024, DEFAULT_ALIGN);
+  assert(block.ptr == NULL);
+  block = ts->vtable->alloc(ts, 1 << 16, DEFAULT_ALIGN);
+  assert(block.ptr == NULL);
+  gpa_thread_safe_set_memory_limit(ts, SIZE_MAX);
+  block = ts->vtable->alloc(ts, 1024, DEFAULT_ALIGN);
+  assert(block.ptr != NULL);
+  ts->vtable->free(ts, block);
+  destroy_thread_safe_gpa_allocator(ts);
+
+  printf("all out of memory tests passed\n");
+}
+
+static bool all_zero(MemoryBlock block) {
+  for (size_t i = 0; i < block.size; i++) {
+    if (((unsigned char *)block.ptr)[i] != 0)
+      return false;
+  }
+  return true;
+}
+
+void test_alloc_zeroed(void) {
+  // big fills stream from the first aligned byte, the edges are memset
+  size_t size = (3 << 20) + 5;
+  char *buffer = map_pages(size + 64, 12);
+  memset(buffer, 0x22, size + 64);
+  fill_memory(buffer + 3, 0x11, size);
+  assert(buffer[2] == 0x22 && buffer[3] == 0x11);
+  assert(buffer[size / 2] == 0x11 && buffer[size + 2] == 0x11);
+  assert(buffer[size + 3] == 0x22);
+  fill_memory(buffer + 3, 0, size);
+  assert(all_zero((MemoryBlock){buffer + 3, size}));
+  munmap(buffer, size + 64);
+
+  // a reused gpa slot gets cleared, so does a cached large mapping
+  Allocator *gpa = create_gpa_allocator();
+  MemoryBlock block = gpa->vtable->alloc(gpa, 100, DEFAULT_ALIGN);
+  memset(block.ptr, 0xFF, block.size);
+  gpa->vtable->free(gpa, block);
+  MemoryBlock zeroed = gpa->vtable->alloc_zeroed(gpa, 100, DEFAULT_ALIGN);
+  assert(zeroed.ptr == block.ptr && all_zero(zeroed));
+  MemoryBlock bumped = gpa->vtable->alloc_zeroed(gpa, 100, DEFAULT_ALIGN);
+  assert(bumped.ptr != NULL && all_zero(bumped));
+  gpa->vtable->free(gpa, zeroed);
+  gpa->vtable->free(gpa, bumped);
+
+  block = gpa->vtable->alloc(gpa, 2 << 20, DEFAULT_ALIGN);
+  memset(block.ptr, 0xFF, block.size);
+  gpa->vtable->free(gpa, block);
+  zeroed = gpa->vtable->alloc_zeroed(gpa, 2 << 20, DEFAULT_ALIGN);
+  assert(zeroed.ptr == block.ptr && all_zero(zeroed));
+  gpa->vtable->free(gpa, zeroed);
+  zeroed = gpa->vtable->alloc_zeroed(gpa, 1 << 16, 16);
+  assert((uintptr_t)zeroed.ptr % (1 << 16) == 0 && all_zero(zeroed));
+  gpa->vtable->free(gpa, zeroed);
+
+  // an arena only clears what a reset, restore or shrink gave back
+  Allocator *arena = create_arena_allocator();
+  block = arena->vtable->alloc_zeroed(arena, 3000, DEFAULT_ALIGN);
+  assert(all_zero(block));
+  memset(block.ptr, 0xFF, block.size);
+  assert(arena->vtable->resize(arena, &block, DEFAULT_ALIGN, 8));
+  zeroed = arena->vtable->alloc_zeroed(arena, 2000, DEFAULT_ALIGN);
+  assert(zeroed.ptr == (char *)block.ptr + 8 && all_zero(zeroed));
+
+  ArenaSavepoint savepoint = arena_save(arena);
+  block = arena->vtable->alloc(arena, 1 << 16, DEFAULT_ALIGN);
+  memset(block.ptr, 0xFF, block.size);
+  arena_restore(arena, savepoint);
+  zeroed = arena->vtable->alloc_zeroed(arena, 1 << 16, DEFAULT_ALIGN);
+  assert(zeroed.ptr == block.ptr && all_zero(zeroed));
+
+  for (int i = 0; i < 4; i++) {
+    block = arena->vtable->alloc(arena, 5000, DEFAULT_ALIGN);
+    memset(block.ptr, 0xFF, block.size);
+  }
+  arena_reset(arena, ARENA_RETAIN_CAPACITY, 0);
+  for (int i = 0; i < 30; i++) {
+    zeroed = arena->vtable->alloc_zeroed(arena, 5000, DEFAULT_ALIGN);
+    assert(all_zero(zeroed));
+  }
+  arena->vtable->free(arena, zeroed);
+
+  // everything else clears what it hands out
+  Allocator *ts = create_thread_safe_gpa_allocator();
+  block = ts->vtable->alloc(ts, 64, DEFAULT_ALIGN);
+  memset(block.ptr, 0xFF, block.size);
+  ts->vtable->free(ts, block);
+  zeroed = ts->vtable->alloc_zeroed(ts, 64, DEFAULT_ALIGN);
+  assert(zeroed.ptr == block.ptr && all_zero(zeroed));
+  ts->vtable->free(ts, zeroed);
+  zeroed = ts->vtable->alloc_zeroed(ts, 10000, DEFAULT_ALIGN);
+  assert(all_zero(zeroed));
+  ts->vtable->free(ts, zeroed);
+  destroy_thread_safe_gpa_allocator(ts);
+
+  Allocator *pool = create_memory_pool(48, DEFAULT_ALIGN);
+  block = pool->vtable->alloc(pool, 48, DEFAULT_ALIGN);
+  memset(block.ptr, 0xFF, block.size);
+  pool->vtable->free(pool, block);
+  zeroed = pool->vtable->alloc_zeroed(pool, 48, DEFAULT_ALIGN);
+  assert(zeroed.ptr == block.ptr && all_zero(zeroed));
+  memory_pool_deinit(pool);
+
+  char stack[256];
+  memset(stack, 0xFF, sizeof(stack));
+  StackFallbackAllocator sfa;
+  Allocator *scratch =
+      init_stack_fallback_allocator(&sfa, stack, sizeof(stack), gpa);
+  zeroed = scratch->vtable->alloc_zeroed(scratch, 64, DEFAULT_ALIGN);
+  assert(stack_fallback_owns(&sfa, zeroed.ptr) && all_zero(zeroed));
+  zeroed = scratch->vtable->alloc_zeroed(scratch, 1000, DEFAULT_ALIGN);
+  assert(!stack_fallback_owns(&sfa, zeroed.ptr) && all_zero(zeroed));
+  scratch->vtable->free(scratch, zeroed);
+
+  Allocator *c = create_c_allocator();
+  zeroed = c->vtable->alloc_zeroed(c, 300, DEFAULT_ALIGN);
+  assert(all_zero(zeroed));
+  c->vtable->free(c, zeroed);
+  zeroed = c->vtable->alloc_zeroed(c, 300, 6);
+  assert((uintptr_t)zeroed.ptr % 64 == 0 && all_zero(zeroed));
+  c->vtable->free(c, zeroed);
+
+  printf("all zeroed allocation tests passed\n");
+}
+
+// fills a few pages of 512s through its cache and frees them, the pages go
+// empty once the central pool drains what the thread handed back on exit
+static void *gpa_decay_worker(void *arg) {
+  Allocator *allocator = arg;
+  MemoryBlock blocks[24];
+  for (int i = 0; i < 24; i++) {
+    blocks[i] = allocator->vtable->alloc(allocator, 512, DEFAULT_ALIGN);
+  }
+  for (int i = 0; i < 24; i++) {
+    allocator->vtable->free(allocator, blocks[i]);
+  }
+  return NULL;
+}
+
+void test_gpa_decay(void) {
+  // two pages of 512s, the older one emptied
+  Allocator *allocator = create_gpa_allocator();
+  GeneralPurposeAllocator *gpa = (GeneralPurposeAllocator *)allocator;
+  gpa_set_decay(allocator, 20);
+  MemoryBlock blocks[9];
+  for (int i = 0; i < 9; i++) {
+    blocks[i] = allocator->vtable->alloc(allocator, 512, DEFAULT_ALIGN);
+  }
+  uint32_t used = gpa->used_pages;
+  for (int i = 0; i < 8; i++) {
+    allocator->vtable->free(allocator, blocks[i]);
+  }
+  GPABucket *empty = gpa_bucket_of(blocks[0].ptr);
+  assert(empty->live == 0 && gpa->used_pages == used);
+
+  // while it waits it is still the class's page, no new one is needed
+  MemoryBlock again = allocator->vtable->alloc(allocator, 512, DEFAULT_ALIGN);
+  assert(gpa_bucket_of(again.ptr) == empty && gpa->used_pages == used);
+  allocator->vtable->free(allocator, again);
+
+  // from the second tick on it gets purged, the last page of a class stays
+  struct timespec wait = {0, 60 * 1000 * 1000};
+  nanosleep(&wait, NULL);
+  gpa_decay(allocator);
+  assert(gpa->used_pages == used - 1);
+  allocator->vtable->free(allocator, blocks[8]);
+  gpa_set_decay(allocator, 0);
+  assert(gpa->used_pages == used - 1);
+
+  // the thread-safe gpa decays its central pool under the lock, pages only
+  // go empty once their slots came back from the thread caches
+  Allocator *ts = create_thread_safe_gpa_allocator();
+  GeneralPurposeAllocator *central = &((ThreadSafeGPA *)ts)->central;
+  gpa_thread_safe_set_decay(ts, 50);
+  pthread_t worker;
+  pthread_create(&worker, NULL, gpa_decay_worker, ts);
+  pthread_join(worker, NULL);
+  uint32_t central_used = central->used_pages;
+  gpa_thread_safe_decay(ts); // drains the remote frees, nothing is due yet
+  assert(central->used_pages == central_used);
+  uint32_t class_pages = 0;
+  for (GPABucket *b = central->buckets[gpa_size_class(512)]; b; b = b->prev) {
+    assert(b->live == 0);
+    class_pages++;
+  }
+  assert(class_pages > 1);
+
+  struct timespec ts_wait = {0, 150 * 1000 * 1000};
+  nanosleep(&ts_wait, NULL);
+  gpa_thread_safe_decay(ts);
+  assert(central->used_pages == central_used - (class_pages - 1));
+  gpa_thread_safe_set_decay(ts, 0);
+  assert(central->used_pages == central_used - (class_pages - 1));
+  destroy_thread_safe_gpa_allocator(ts);
 
-  // str4 should be on next page
-  size_t arena_size = (sizeof(ArenaAllocator) + 7) & ~7; // 8-byte alignment
-  assert(str4.ptr == (char *)arena->next + arena_size);
-  assert(str4.ptr != (char *)str3.ptr + 8);
+  printf("all gpa decay tests passed\n");
+}
 
-  // fill existing available bucket
-  MemoryBlock str5 = allocator->vtable->alloc(allocator, 3);
-  assert(str5.ptr != NULL);
-  assert(str5.ptr != (char *)str4.ptr + 8);
-  assert(str5.ptr == (char *)str3.ptr + 8);
-  memcpy(str5.ptr, "55\0", 2);
+void test_stats(void) {
+  AllocatorStats before, after;
+  Allocator *gpa = create_gpa_allocator();
+  gpa->vtable->stats(gpa, &before);
+  MemoryBlock small = gpa->vtable->alloc(gpa, 257, DEFAULT_ALIGN);
+  MemoryBlock large = gpa->vtable->alloc(gpa, 1 << 20, DEFAULT_ALIGN);
+  gpa->vtable->stats(gpa, &after);
+#if ZALLOC_STATS
+  int cls = gpa_size_class(257);
+  assert(after.counters.allocs == before.counters.allocs + 2);
+  assert(after.counters.requested_bytes - before.counters.requested_bytes ==
+         257 + (1 << 20));
+  assert(after.counters.rounded_bytes - before.counters.rounded_bytes ==
+         320 + (1 << 20));
+  assert(after.counters.live_bytes - before.counters.live_bytes ==
+         320 + (1 << 20));
+  assert(after.class_pages[cls] ==
+         before.class_pages[cls] + gpa_slab_pages[cls]);
+  assert(after.mmaps == before.mmaps + 1); // the large block, nothing cached
+#endif
 
-  // free page
-  allocator->vtable->free(allocator, (MemoryBlock){NULL, 0});
+  large = gpa->vtable->remap(gpa, large, DEFAULT_ALIGN, 2 << 20);
+  gpa->vtable->free(gpa, small);
+  gpa->vtable->free(gpa, large);
+  gpa->vtable->stats(gpa, &after);
+#if ZALLOC_STATS
+  assert(after.counters.live_bytes == before.counters.live_bytes);
+  assert(after.counters.peak_bytes >= before.counters.live_bytes + (2 << 20));
+  assert(after.counters.frees == before.counters.frees + 2);
+  assert(after.mremaps > before.mremaps);
+#endif
 
-  // uncomment to check whether mem has been munmap'd
-  // memset(str1.ptr, 1, 1);
-  // memset(str4.ptr, 1, 1);
+  // the arena's peak survives a reset, its live bytes don't
+  Allocator *arena = create_arena_allocator();
+  for (int i = 0; i < 4; i++)
+    arena->vtable->alloc(arena, 3000, DEFAULT_ALIGN);
+  arena_reset(arena, ARENA_RETAIN_CAPACITY, 0);
+  arena->vtable->stats(arena, &after);
+#if ZALLOC_STATS
+  assert(after.chunks == 3);
+  assert(after.counters.live_bytes == 0);
+  assert(after.counters.peak_bytes == 4 * 3000);
+#else
+  assert(after.counters.allocs == 0 && after.chunks == 0 && after.mmaps == 0);
+#endif
+  arena->vtable->free(arena, (MemoryBlock){0});
 
-  printf("all arena allocator tests passed\n");
+  printf("all stats tests passed\n");
 }
 
-typedef struct GPABucket GPABucket;
-typedef struct GeneralPurposeAllocator GeneralPurposeAllocator;
+// "Why do I have to pass allocators around in Zig?"
+// because userland decides which allocation strategy to use
+// and where the data should be placed
+void alloc_hello(Allocator *allocator) {
+  const char *str = "hello world\n";
+  size_t str_size = strlen(str) + 1;
+  MemoryBlock str1 =
+      allocator->vtable->alloc(allocator, str_size, DEFAULT_ALIGN);
+  memcpy(str1.ptr, str, str_size);
+}
 
-struct GPABucket {
-  void *offset;
-  size_t bucket_size;
-  GPABucket *prev;
-};
+// containers that grow through the allocator they're given. growth asks for
+// resize first, which the fba and arena grant for their last block, the gpa
+// within a slot and malloc within its usable size, and only then remap,
+// which copies. nothing is freed while growing, remap knows what the
+// allocator does with the old block, so on an arena they're safe to use and
+// go away with the arena instead of their deinit
+#define CONTAINER_MIN_BYTES 64
 
-struct GeneralPurposeAllocator {
-  Allocator base;
-  GPABucket *buckets[12];
-};
+// grows memory to size, false if the allocator is out of memory and memory
+// is left as it was
+static bool container_grow(Allocator *allocator, MemoryBlock *memory,
+                           uint8_t log2_align, size_t size) {
+  if (memory->ptr == NULL) {
+    MemoryBlock block = allocator->vtable->alloc(allocator, size, log2_align);
+    if (block.ptr == NULL)
+      return false;
+    *memory = block;
+    return true;
+  }
+  if (allocator->vtable->resize(allocator, memory, log2_align, size))
+    return true;
+  MemoryBlock moved =
+      allocator->vtable->remap(allocator, *memory, log2_align, size);
+  if (moved.ptr == NULL)
+    return false;
+  *memory = moved;
+  return true;
+}
 
-static inline int log2_ceil(size_t x) {
+// doubles so appends are amortized O(1). size is at most ALLOC_SIZE_MAX, the
+// doubling can't overflow
+static inline size_t container_grown_size(size_t size, size_t needed) {
+  size_t grown = size * 2;
+  if (grown < needed)
+    grown = needed;
+  return grown < CONTAINER_MIN_BYTES ? CONTAINER_MIN_BYTES : grown;
+}
+
+// elements of any one non-zero size, 8-byte aligned. whatever the allocator
+// rounded the block up to counts as capacity
+typedef struct {
+  Allocator *allocator;
+  MemoryBlock memory;
+  size_t len;
+  size_t elem_size;
+} ArrayList;
+
+ArrayList array_list_init(Allocator *allocator, size_t elem_size) {
+  return (ArrayList){allocator, {NULL, 0}, 0, elem_size};
+}
+
+static inline size_t array_list_capacity(const ArrayList *list) {
+  return list->memory.size / list->elem_size;
+}
+
+// room for count more elements, false if the allocator is out of memory
+bool array_list_reserve(ArrayList *list, size_t count) {
+  if (count <= array_list_capacity(list) - list->len)
+    return true;
+  if (count > ALLOC_SIZE_MAX / list->elem_size - list->len)
+    return false;
+  size_t needed = (list->len + count) * list->elem_size;
+  return container_grow(list->allocator, &list->memory, DEFAULT_ALIGN,
+                        container_grown_size(list->memory.size, needed));
+}
+
+static inline void *array_list_at(const ArrayList *list, size_t index) {
+  return (char *)list->memory.ptr + index * list->elem_size;
+}
+
+// the slot for one more element, NULL if the allocator is out of memory
+static inline void *array_list_push(ArrayList *list) {
+  if (list->len == array_list_capacity(list) && !array_list_reserve(list, 1))
+    return NULL;
+  return array_list_at(list, list->len++);
+}
+
+// the last element, good until the next push. NULL if the list is empty
+static inline void *array_list_pop(ArrayList *list) {
+  return list->len == 0 ? NULL : array_list_at(list, --list->len);
+}
+
+void array_list_deinit(ArrayList *list) {
+  if (list->memory.ptr != NULL)
+    list->allocator->vtable->free(list->allocator, list->memory);
+  *list = array_list_init(list->allocator, list->elem_size);
+}
+
+// uint64 keys to uint64 values, open addressing with linear probing. keys,
+// values and a tag byte per slot are separate arrays in one block, probes
+// scan the tags and only touch a key when its tag matches
+#define HASH_MAP_MIN 16
+#define HASH_MAP_STALE 1 // still at its slot from before a grow
+
+typedef struct {
+  Allocator *allocator;
+  MemoryBlock memory;
+  uint64_t *keys;
+  uint64_t *values;
+  uint8_t *tags; // 0 empty, otherwise 0x80 and the top bits of the hash
+  size_t capacity; // a power of two kept under 3/4 full, or 0
+  size_t count;
+} HashMap;
+
+HashMap hash_map_init(Allocator *allocator) {
+  return (HashMap){allocator, {NULL, 0}, NULL, NULL, NULL, 0, 0};
+}
+
+static inline uint64_t hash_map_hash(uint64_t key) {
+  uint64_t hash = key * 0x9E3779B97F4A7C15ull;
+  return hash ^ (hash >> 29);
+}
+
+static inline uint8_t hash_map_tag(uint64_t hash) {
+  return 0x80 | (uint8_t)(hash >> 57);
+}
+
+// where key is, or the empty slot it would go in. capacity isn't 0
+static inline size_t hash_map_find(const HashMap *map, uint64_t key,
+                                   uint64_t hash) {
+  size_t mask = map->capacity - 1, i = hash & mask;
+  uint8_t tag = hash_map_tag(hash);
+  while (map->tags[i] != 0 && (map->tags[i] != tag || map->keys[i] != key))
+    i = (i + 1) & mask;
+  return i;
+}
+
+// NULL if key isn't there
+static inline uint64_t *hash_map_get(const HashMap *map, uint64_t key) {
+  if (map->capacity == 0)
+    return NULL;
+  size_t i = hash_map_find(map, key, hash_map_hash(key));
+  return map->tags[i] != 0 ? &map->values[i] : NULL;
+}
+
+// the arrays of a given capacity within memory
+static void hash_map_layout(HashMap *map, size_t capacity) {
+  map->capacity = capacity;
+  map->keys = map->memory.ptr;
+  map->values = map->keys + capacity;
+  map->tags = (uint8_t *)(map->values + capacity);
+}
+
+// moves the entry in slot i to where it belongs in the grown table. an entry
+// that hasn't moved yet in the way is swapped out and goes next, so moved
+// entries only ever probe past other moved ones
+static void hash_map_rehash_slot(HashMap *map, size_t i) {
+  size_t mask = map->capacity - 1;
+  uint64_t key = map->keys[i], value = map->values[i];
+  map->tags[i] = 0;
+  for (;;) {
+    uint64_t hash = hash_map_hash(key);
+    size_t j = hash & mask;
+    while (map->tags[j] >= 0x80)
+      j = (j + 1) & mask;
+    bool stale = map->tags[j] == HASH_MAP_STALE;
+    uint64_t next_key = map->keys[j], next_value = map->values[j];
+    map->keys[j] = key;
+    map->values[j] = value;
+    map->tags[j] = hash_map_tag(hash);
+    if (!stale)
+      return;
+    key = next_key;
+    value = next_value;
+  }
+}
+
+// doubles the block through resize or remap and rehashes in place, no
+// second table is needed and nothing is freed
+static bool hash_map_grow(HashMap *map) {
+  size_t old = map->capacity;
+  size_t capacity = old == 0 ? HASH_MAP_MIN : old * 2;
+  if (capacity > ALLOC_SIZE_MAX / 17)
+    return false;
+  if (!container_grow(map->allocator, &map->memory, DEFAULT_ALIGN,
+                      capacity * 17))
+    return false;
+
+  // the old arrays sit at the old offsets, tags first since they move
+  // furthest
+  char *base = map->memory.ptr;
+  memmove(base + capacity * 16, base + old * 16, old);
+  memmove(base + capacity * 8, base + old * 8, old * 8);
+  hash_map_layout(map, capacity);
+  memset(map->tags + old, 0, capacity - old);
+  for (size_t i = 0; i < old; i++) {
+    if (map->tags[i] != 0)
+      map->tags[i] = HASH_MAP_STALE;
+  }
+  for (size_t i = 0; i < old; i++) {
+    if (map->tags[i] == HASH_MAP_STALE)
+      hash_map_rehash_slot(map, i);
+  }
+  return true;
+}
+
+// inserts or overwrites, false if the allocator is out of memory
+bool hash_map_put(HashMap *map, uint64_t key, uint64_t value) {
+  if ((map->count + 1) * 4 > map->capacity * 3) {
+    uint64_t *existing = hash_map_get(map, key);
+    if (existing != NULL) {
+      *existing = value;
+      return true;
+    }
+    if (!hash_map_grow(map))
+      return false;
+  }
+  uint64_t hash = hash_map_hash(key);
+  size_t i = hash_map_find(map, key, hash);
+  if (map->tags[i] == 0) {
+    map->tags[i] = hash_map_tag(hash);
+    map->keys[i] = key;
+    map->count++;
+  }
+  map->values[i] = value;
+  return true;
+}
+
+// backward shift instead of tombstones, false if key wasn't there
+bool hash_map_remove(HashMap *map, uint64_t key) {
+  if (map->capacity == 0)
+    return false;
+  size_t mask = map->capacity - 1;
+  size_t i = hash_map_find(map, key, hash_map_hash(key));
+  if (map->tags[i] == 0)
+    return false;
+  for (size_t j = (i + 1) & mask; map->tags[j] != 0; j = (j + 1) & mask) {
+    size_t home = hash_map_hash(map->keys[j]) & mask;
+    if (((j - home) & mask) >= ((j - i) & mask)) {
+      map->keys[i] = map->keys[j];
+      map->values[i] = map->values[j];
+      map->tags[i] = map->tags[j];
+      i = j;
+    }
+  }
+  map->tags[i] = 0;
+  map->count--;
+  return true;
+}
+
+void hash_map_deinit(HashMap *map) {
+  if (map->memory.ptr != NULL)
+    map->allocator->vtable->free(map->allocator, map->memory);
+  *map = hash_map_init(map->allocator);
+}
+
+// a string that grows at its end, always NUL terminated once there is one
+typedef struct {
+  Allocator *allocator;
+  MemoryBlock memory;
+  size_t len; // without the NUL
+} StringBuilder;
+
+StringBuilder string_builder_init(Allocator *allocator) {
+  return (StringBuilder){allocator, {NULL, 0}, 0};
+}
+
+// room for len more bytes and the NUL
+static bool string_builder_reserve(StringBuilder *sb, size_t len) {
+  if (sb->memory.size > sb->len && len < sb->memory.size - sb->len)
+    return true;
+  if (len >= ALLOC_SIZE_MAX - sb->len)
+    return false;
+  return container_grow(
+      sb->allocator, &sb->memory, 0,
+      container_grown_size(sb->memory.size, sb->len + len + 1));
+}
+
+// false if the allocator is out of memory, the string is as it was then
+bool string_builder_append(StringBuilder *sb, const char *str, size_t len) {
+  if (!string_builder_reserve(sb, len))
+    return false;
+  char *end = (char *)sb->memory.ptr + sb->len;
+  memcpy(end, str, len);
+  end[len] = '\0';
+  sb->len += len;
+  return true;
+}
+
+// printf straight into the spare capacity, a second try if it didn't fit
+__attribute__((format(printf, 2, 3))) bool
+string_builder_appendf(StringBuilder *sb, const char *fmt, ...) {
+  for (int attempt = 0; attempt < 2; attempt++) {
+    size_t spare = sb->memory.size > sb->len ? sb->memory.size - sb->len : 0;
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(spare ? (char *)sb->memory.ptr + sb->len : NULL,
+                        spare, fmt, args);
+    va_end(args);
+    if (len < 0)
+      return false;
+    if ((size_t)len < spare) {
+      sb->len += len;
+      return true;
+    }
+    // vsnprintf cut it short and wrote a NUL at the end, put it back
+    if (spare)
+      ((char *)sb->memory.ptr)[sb->len] = '\0';
+    if (!string_builder_reserve(sb, len))
+      return false;
+  }
+  return false;
+}
+
+static inline const char *string_builder_cstr(const StringBuilder *sb) {
+  return sb->memory.ptr != NULL ? sb->memory.ptr : "";
+}
+
+void string_builder_deinit(StringBuilder *sb) {
+  if (sb->memory.ptr != NULL)
+    sb->allocator->vtable->free(sb->allocator, sb->memory);
+  *sb = string_builder_init(sb->allocator);
+}
+
+static void test_containers_on(Allocator *allocator, bool arena) {
+  ArrayList list = array_list_init(allocator, sizeof(uint32_t));
+  for (uint32_t i = 0; i < 50000; i++) {
+    *(uint32_t *)array_list_push(&list) = i;
+  }
+  assert(list.len == 50000 && array_list_capacity(&list) >= 50000);
+  for (uint32_t i = 0; i < 50000; i++) {
+    assert(*(uint32_t *)array_list_at(&list, i) == i);
+  }
+  assert(*(uint32_t *)array_list_pop(&list) == 49999 && list.len == 49999);
+
+  HashMap map = hash_map_init(allocator);
+  assert(hash_map_get(&map, 1) == NULL && !hash_map_remove(&map, 1));
+  for (uint64_t i = 0; i < 20000; i++) {
+    assert(hash_map_put(&map, i * 7919, i));
+  }
+  assert(map.count == 20000 && map.capacity == 32768);
+  assert(hash_map_put(&map, 7919, 42) && map.count == 20000);
+  assert(*hash_map_get(&map, 7919) == 42);
+  for (uint64_t i = 0; i < 20000; i += 2) {
+    assert(hash_map_remove(&map, i * 7919));
+  }
+  assert(map.count == 10000 && !hash_map_remove(&map, 0));
+  for (uint64_t i = 2; i < 20000; i++) {
+    uint64_t *value = hash_map_get(&map, i * 7919);
+    assert(i % 2 == 0 ? value == NULL : *value == i);
+  }
+
+  StringBuilder sb = string_builder_init(allocator);
+  assert(strcmp(string_builder_cstr(&sb), "") == 0);
+  for (int i = 0; i < 1000; i++) {
+    assert(string_builder_appendf(&sb, "%d,", i));
+  }
+  assert(string_builder_append(&sb, "end", 3));
+  assert(sb.len == 10 + 90 * 2 + 900 * 3 + 1000 + 3);
+  assert(strncmp(string_builder_cstr(&sb), "0,1,2,", 6) == 0);
+  assert(strcmp(string_builder_cstr(&sb) + sb.len - 11, "998,999,end") == 0);
+
+  if (arena) {
+    allocator->vtable->free(allocator, (MemoryBlock){0});
+    return;
+  }
+  array_list_deinit(&list);
+  hash_map_deinit(&map);
+  string_builder_deinit(&sb);
+  assert(list.memory.ptr == NULL && map.capacity == 0 && sb.len == 0);
+}
+
+void test_containers(void) {
+  // the last block of a bump allocator grows in place, nothing is copied
+  static char buf[1 << 20];
+  Allocator *fba = create_fixed_buffer_allocator(buf, sizeof(buf));
+  ArrayList list = array_list_init(fba, sizeof(uint64_t));
+  for (uint64_t i = 0; i < 10000; i++) {
+    *(uint64_t *)array_list_push(&list) = i;
+  }
+  void *grown = list.memory.ptr;
+  assert(array_list_reserve(&list, 10000) && list.memory.ptr == grown);
+
+  // behind another block it's copied
+  fba->vtable->alloc(fba, 8, DEFAULT_ALIGN);
+  assert(array_list_reserve(&list, list.memory.size / sizeof(uint64_t)));
+  assert(list.memory.ptr != grown);
+  assert(*(uint64_t *)array_list_at(&list, 9999) == 9999);
+
+  // out of memory leaves the list as it was
+  size_t size = list.memory.size;
+  assert(!array_list_reserve(&list, sizeof(buf)));
+  assert(!array_list_reserve(&list, SIZE_MAX));
+  assert(list.memory.size == size && list.len == 10000);
+
+  // so does a grow of the hash map
+  HashMap map = hash_map_init(fba);
+  uint64_t key = 0;
+  while (hash_map_put(&map, key, key))
+    key++;
+  assert(map.count == key);
+  for (uint64_t i = 0; i < key; i++) {
+    assert(*hash_map_get(&map, i) == i);
+  }
+
+  test_containers_on(create_arena_allocator(), true);
+  test_containers_on(create_gpa_allocator(), false);
+  test_containers_on(create_c_allocator(), false);
+
+  printf("all container tests passed\n");
+}
+
+// micro-benchmarks, run with ./zalloc bench
+static volatile size_t bench_sink;
+
+static double bench_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// what log2_ceil was before the bit scan, kept as the baseline
+static int log2_ceil_loop(size_t x) {
   int result = 0;
   size_t value = 1;
   if (x == 0)
@@ -300,187 +5444,413 @@ static inline int log2_ceil(size_t x) {
   return result;
 }
 
-static MemoryBlock gpa_alloc(Allocator *self, size_t size) {
-  struct GeneralPurposeAllocator *gpa = (struct GeneralPurposeAllocator *)self;
-  if (size <= 0) {
-    perror("invalid allocation size");
-    exit(1);
-  }
+#define BENCH_SIZE_MAPPING(name, expr)                                         \
+  do {                                                                         \
+    size_t acc = 0;                                                            \
+    double start = bench_now();                                                \
+    for (size_t i = 0; i < iterations; i++) {                                  \
+      size_t x = sizes[i & 1023];                                              \
+      acc += (expr);                                                           \
+    }                                                                          \
+    double elapsed = bench_now() - start;                                      \
+    bench_sink = acc;                                                          \
+    printf("%-28s %6.2f ns/op\n", name, elapsed * 1e9 / iterations);          \
+  } while (0)
 
-  int bucket_index = log2_ceil(size);
-  size_t bucket_size = 1 << bucket_index;
-  if (bucket_index >= 12) {
-    // mmap does alignment internally
-    void *page = new_page_memory(size);
-    return (MemoryBlock){page, size};
+static void bench_size_mapping(void) {
+  const size_t iterations = (size_t)1 << 26;
+  size_t sizes[1024];
+  uint32_t rng = 1;
+  for (int i = 0; i < 1024; i++) {
+    rng = rng * 1103515245 + 12345;
+    sizes[i] = 1 + (rng >> 16) % GPA_MAX_SMALL;
   }
 
-  // if bucket doesn't exist or it ooms
-  GPABucket *bucket = gpa->buckets[bucket_index];
-  if (bucket == NULL ||
-      (char *)bucket->offset + bucket_size > (char *)bucket + 4096) {
-    struct GPABucket *new_bucket = new_page_memory(4096);
-    new_bucket->bucket_size = bucket_size;
-    new_bucket->offset = (char *)new_bucket + sizeof(struct GPABucket);
-    new_bucket->prev = gpa->buckets[bucket_index]; // link to previous bucket
-    gpa->buckets[bucket_index] = new_bucket;
-    bucket = new_bucket;
-  }
-
-  struct GPABucket *current_bucket = gpa->buckets[bucket_index];
-  void *ptr = current_bucket->offset;
-  current_bucket->offset = (char *)current_bucket->offset + bucket_size;
-  return (MemoryBlock){ptr, bucket_size};
+  BENCH_SIZE_MAPPING("log2_ceil (loop)", log2_ceil_loop(x));
+  BENCH_SIZE_MAPPING("log2_ceil (bit scan)", log2_ceil(x));
+  BENCH_SIZE_MAPPING("gpa_size_class", gpa_size_class(x));
 }
 
-static void gpa_free(Allocator *self, MemoryBlock memory) {
-  memset(memory.ptr, 0xAA, memory.size);
+// the same bump through the vtable and through zalloc on the concrete type,
+// the arena is reset every 4096 blocks so it stays in its first chunks
+#define BENCH_DISPATCH(name, expr)                                             \
+  do {                                                                         \
+    size_t acc = 0;                                                            \
+    double start = bench_now();                                                \
+    for (size_t i = 0; i < iterations; i++) {                                  \
+      acc += (uintptr_t)(expr).ptr;                                            \
+      if ((i & 4095) == 4095)                                                  \
+        arena_reset(allocator, ARENA_RETAIN_CAPACITY, 0);                      \
+    }                                                                          \
+    double elapsed = bench_now() - start;                                      \
+    bench_sink = acc;                                                          \
+    printf("%-28s %6.2f ns/op\n", name, elapsed * 1e9 / iterations);          \
+  } while (0)
 
-  GeneralPurposeAllocator *gpa = (GeneralPurposeAllocator *)self;
-  int idx = log2_ceil(memory.size);
-  if (idx >= 12) {
-    // free large allocations directly
-    munmap(memory.ptr, memory.size);
-    return;
-  }
+static void bench_dispatch(void) {
+  const size_t iterations = (size_t)1 << 26;
+  Allocator *allocator = create_arena_allocator();
+  ArenaAllocator *arena = (ArenaAllocator *)allocator;
 
-  GPABucket **bucket_ptr = &gpa->buckets[idx];
-  GPABucket *bucket = gpa->buckets[idx];
+  BENCH_DISPATCH("arena alloc (vtable)",
+                 allocator->vtable->alloc(allocator, 16, DEFAULT_ALIGN));
+  BENCH_DISPATCH("arena alloc (zalloc)", zalloc(arena, 16, DEFAULT_ALIGN));
+  allocator->vtable->free(allocator, (MemoryBlock){NULL, 0});
+}
 
-  char *curr = (char *)bucket + sizeof(GPABucket);
-  char *end = (char *)bucket + 4096;
-  bool page_empty = true;
 
-  while (curr < end) {
-    if (*curr != (char)0xAA) {
-      page_empty = false;
-      break;
+// workloads, every run gets a fresh process so peak rss is its own.
+// build with -O2 -DNDEBUG, safety mode fills would dominate otherwise
+#define BENCH_SAMPLE_EVERY 64 // only every 64th op pays for two clock reads
+#define BENCH_MAX_SAMPLES ((size_t)1 << 20)
+#define BENCH_THREADS 4
+
+typedef struct {
+  const char *name;
+  Allocator *(*create)(void);
+  // bump allocators can't free single blocks, their rounds end in a reset
+  void (*reset)(Allocator *allocator);
+  bool thread_safe;
+} BenchTarget;
+
+typedef struct {
+  double *data; // ns per sampled op
+  size_t count;
+} BenchSamples;
+
+typedef struct {
+  Allocator *allocator;
+  const BenchTarget *target;
+  size_t ops;
+  BenchSamples samples;
+} BenchRun;
+
+static Allocator *bench_create_fba(void) {
+  size_t size = (size_t)1 << 30; // only what a round touches gets faulted in
+  return create_fixed_buffer_allocator(map_pages(size, 12), size);
+}
+
+static void bench_reset_fba(Allocator *allocator) {
+  FixedBufferAllocator *fba = (FixedBufferAllocator *)allocator;
+  fba->offset = (char *)fba + sizeof(FixedBufferAllocator);
+}
+
+static void bench_reset_arena(Allocator *allocator) {
+  arena_reset(allocator, ARENA_RETAIN_CAPACITY, 0);
+}
+
+static const BenchTarget bench_targets[] = {
+    {"fba", bench_create_fba, bench_reset_fba, false},
+    {"arena", create_arena_allocator, bench_reset_arena, false},
+    {"gpa", create_gpa_allocator, NULL, false},
+    {"thread-safe gpa", create_thread_safe_gpa_allocator, NULL, true},
+    {"malloc", create_c_allocator, NULL, true},
+};
+
+static inline uint32_t bench_rand(uint32_t *rng) {
+  *rng = *rng * 1103515245 + 12345;
+  return *rng >> 8;
+}
+
+// 80% up to 128 bytes, 15% up to 2 KiB, the rest up to 64 KiB
+static size_t bench_mixed_size(uint32_t *rng) {
+  uint32_t r = bench_rand(rng);
+  uint32_t pick = r % 100;
+  r /= 100;
+  if (pick < 80)
+    return 8 + r % 121;
+  if (pick < 95)
+    return 129 + r % 1920;
+  return 2049 + r % 63488;
+}
+
+// a page's worth of writes per block, so rss counts what a caller would touch
+static inline void bench_touch(MemoryBlock block) {
+  for (size_t i = 0; i < block.size; i += 4096)
+    ((volatile char *)block.ptr)[i] = 1;
+}
+
+static inline void bench_record(BenchSamples *samples, double start) {
+  if (samples->count < BENCH_MAX_SAMPLES)
+    samples->data[samples->count++] = (bench_now() - start) * 1e9;
+}
+
+// a ring of 1024 live blocks, every op frees the oldest and allocates anew
+static void bench_ring(BenchRun *run, bool mixed) {
+  Allocator *allocator = run->allocator;
+  MemoryBlock live[1024] = {0};
+  uint32_t rng = 1;
+  for (size_t i = 0; i < run->ops; i++) {
+    MemoryBlock *block = &live[i & 1023];
+    if ((i & 1023) == 0 && run->target->reset != NULL && i > 0) {
+      run->target->reset(allocator);
+      memset(live, 0, sizeof(live));
     }
-    curr++;
+    size_t size = mixed ? bench_mixed_size(&rng) : 64;
+    double start = i % BENCH_SAMPLE_EVERY == 0 ? bench_now() : 0;
+    if (block->ptr != NULL)
+      allocator->vtable->free(allocator, *block);
+    *block = allocator->vtable->alloc(allocator, size, DEFAULT_ALIGN);
+    if (start != 0)
+      bench_record(&run->samples, start);
+    bench_touch(*block);
   }
+}
+
+static void bench_uniform(BenchRun *run) { bench_ring(run, false); }
+static void bench_mixed(BenchRun *run) { bench_ring(run, true); }
+
+// one thread allocates, another frees what it gets through a spsc ring
+typedef struct {
+  Allocator *allocator;
+  MemoryBlock ring[256];
+  _Atomic size_t head; // next to push, producer only
+  _Atomic size_t tail; // next to pop, consumer only
+  size_t ops;
+} BenchQueue;
 
-  if (page_empty) {
-    GPABucket *tmp = bucket->prev;
-    munmap(bucket, 4096);
-    *bucket_ptr = tmp;
+static void *bench_consumer(void *arg) {
+  BenchQueue *queue = (BenchQueue *)arg;
+  for (size_t i = 0; i < queue->ops; i++) {
+    while (atomic_load_explicit(&queue->head, memory_order_acquire) == i)
+      sched_yield();
+    MemoryBlock block = queue->ring[i % 256];
+    atomic_store_explicit(&queue->tail, i + 1, memory_order_release);
+    queue->allocator->vtable->free(queue->allocator, block);
   }
+  return NULL;
 }
 
-static bool gpa_resize(Allocator *self, MemoryBlock *memory, size_t new_size) {
-  GeneralPurposeAllocator *gpa = (GeneralPurposeAllocator *)self;
-  size_t old_aligned_size = (size_t)1 << log2_ceil(memory->size);
-  int old_bucket_idx = log2_ceil(memory->size);
-  if (old_bucket_idx >= 12) {
-    // don't resize, alloc+free on callsite
-    perror("attempting to resize large allocation");
-    exit(1);
+static void bench_producer_consumer(BenchRun *run) {
+  static BenchQueue queue;
+  queue.allocator = run->allocator;
+  queue.ops = run->ops;
+  atomic_init(&queue.head, 0);
+  atomic_init(&queue.tail, 0);
+  pthread_t consumer;
+  pthread_create(&consumer, NULL, bench_consumer, &queue);
+
+  uint32_t rng = 1;
+  for (size_t i = 0; i < run->ops; i++) {
+    size_t size = 16 + bench_rand(&rng) % 497;
+    double start = i % BENCH_SAMPLE_EVERY == 0 ? bench_now() : 0;
+    MemoryBlock block =
+        run->allocator->vtable->alloc(run->allocator, size, DEFAULT_ALIGN);
+    if (start != 0)
+      bench_record(&run->samples, start);
+    bench_touch(block);
+    while (i - atomic_load_explicit(&queue.tail, memory_order_acquire) >= 256)
+      sched_yield();
+    queue.ring[i % 256] = block;
+    atomic_store_explicit(&queue.head, i + 1, memory_order_release);
   }
+  pthread_join(consumer, NULL);
+}
 
-  GPABucket *old_bucket = gpa->buckets[old_bucket_idx];
+// larson: threads replace random blocks of their own set, and every epoch the
+// sets move on to the next thread so a good share of frees are remote
+#define BENCH_LARSON_BLOCKS 1000
+#define BENCH_LARSON_EPOCHS 8
 
-  // last allocation?
-  if ((char *)memory->ptr + old_aligned_size != old_bucket->offset) {
-    return false;
+typedef struct {
+  BenchRun *run;
+  MemoryBlock *blocks;
+  size_t ops;
+  uint32_t rng;
+  BenchSamples samples;
+} BenchLarson;
+
+static void *bench_larson_thread(void *arg) {
+  BenchLarson *larson = (BenchLarson *)arg;
+  Allocator *allocator = larson->run->allocator;
+  for (size_t i = 0; i < larson->ops; i++) {
+    MemoryBlock *block =
+        &larson->blocks[bench_rand(&larson->rng) % BENCH_LARSON_BLOCKS];
+    size_t size = 16 + bench_rand(&larson->rng) % 1009;
+    double start = i % BENCH_SAMPLE_EVERY == 0 ? bench_now() : 0;
+    if (block->ptr != NULL)
+      allocator->vtable->free(allocator, *block);
+    *block = allocator->vtable->alloc(allocator, size, DEFAULT_ALIGN);
+    if (start != 0)
+      bench_record(&larson->samples, start);
+    bench_touch(*block);
   }
+  return NULL;
+}
 
-  // resize can only happen in same bucket
-  // for different-bucket resize, use alloc+free on callsite
-  size_t new_aligned_size = (size_t)1 << log2_ceil(new_size);
-  int new_bucket_idx = log2_ceil(new_size);
-  if (new_bucket_idx > old_bucket_idx) {
-    return false;
+static void bench_larson(BenchRun *run) {
+  static MemoryBlock sets[BENCH_THREADS][BENCH_LARSON_BLOCKS];
+  BenchLarson larson[BENCH_THREADS];
+  size_t per_thread = run->ops / BENCH_THREADS / BENCH_LARSON_EPOCHS;
+  size_t share = BENCH_MAX_SAMPLES / BENCH_THREADS;
+  for (int t = 0; t < BENCH_THREADS; t++) {
+    larson[t] = (BenchLarson){run, NULL, per_thread, t + 1,
+                              {run->samples.data + t * share, 0}};
   }
 
-  if (new_size < memory->size) {
-    memset((char *)memory->ptr + new_size, 0xAA, memory->size - new_size);
+  for (int epoch = 0; epoch < BENCH_LARSON_EPOCHS; epoch++) {
+    pthread_t threads[BENCH_THREADS];
+    for (int t = 0; t < BENCH_THREADS; t++) {
+      larson[t].blocks = sets[(t + epoch) % BENCH_THREADS];
+      larson[t].samples.count = 0;
+      pthread_create(&threads[t], NULL, bench_larson_thread, &larson[t]);
+    }
+    for (int t = 0; t < BENCH_THREADS; t++) {
+      pthread_join(threads[t], NULL);
+    }
+  }
+
+  // pack every thread's samples of the last epoch together
+  run->samples.count = 0;
+  for (int t = 0; t < BENCH_THREADS; t++) {
+    memmove(run->samples.data + run->samples.count, larson[t].samples.data,
+            larson[t].samples.count * sizeof(double));
+    run->samples.count += larson[t].samples.count;
   }
-  return true;
 }
 
-AllocatorVTable gpa_vtable = {
-    .alloc = gpa_alloc, .free = gpa_free, .resize = gpa_resize};
+// a buffer grows by half from 16 bytes to 1 MiB through remap, over and over
+static void bench_realloc_growth(BenchRun *run) {
+  Allocator *allocator = run->allocator;
+  size_t i = 0;
+  while (i < run->ops) {
+    MemoryBlock buffer = allocator->vtable->alloc(allocator, 16, DEFAULT_ALIGN);
+    while (buffer.size < (1 << 20) && i < run->ops) {
+      size_t new_size = buffer.size + buffer.size / 2;
+      double start = i % BENCH_SAMPLE_EVERY == 0 ? bench_now() : 0;
+      buffer = allocator->vtable->remap(allocator, buffer, DEFAULT_ALIGN,
+                                        new_size);
+      if (start != 0)
+        bench_record(&run->samples, start);
+      ((volatile char *)buffer.ptr)[new_size - 1] = 1;
+      i++;
+    }
+    if (run->target->reset != NULL)
+      run->target->reset(allocator);
+    else
+      allocator->vtable->free(allocator, buffer);
+  }
+}
 
-Allocator *create_gpa_allocator() {
-  // FIXME: inefficient because it's using the 4kb to store GPA's metadata
-  GeneralPurposeAllocator *gpa = new_page_memory(4096);
-  gpa->base.vtable = &gpa_vtable;
-  for (int i = 0; i < 12; i++) {
-    gpa->buckets[i] = NULL;
+// an array list, a hash map and a string builder take one element each per
+// op, and are dropped and started over every 65536 ops
+static void bench_containers(BenchRun *run) {
+  Allocator *allocator = run->allocator;
+  size_t i = 0;
+  while (i < run->ops) {
+    ArrayList list = array_list_init(allocator, sizeof(uint64_t));
+    HashMap map = hash_map_init(allocator);
+    StringBuilder sb = string_builder_init(allocator);
+    for (size_t n = 0; n < 65536 && i < run->ops; n++, i++) {
+      double start = i % BENCH_SAMPLE_EVERY == 0 ? bench_now() : 0;
+      *(uint64_t *)array_list_push(&list) = i;
+      hash_map_put(&map, i * 2654435761u, i);
+      string_builder_append(&sb, "word ", 5);
+      if (start != 0)
+        bench_record(&run->samples, start);
+    }
+    bench_sink += list.len + map.count + sb.len;
+    if (run->target->reset != NULL) {
+      run->target->reset(allocator);
+    } else {
+      array_list_deinit(&list);
+      hash_map_deinit(&map);
+      string_builder_deinit(&sb);
+    }
   }
-  return (Allocator *)gpa;
 }
 
-void test_gpa(Allocator *allocator) {
-  GeneralPurposeAllocator *gpa = (GeneralPurposeAllocator *)allocator;
+typedef struct {
+  const char *name;
+  void (*run)(BenchRun *run);
+  size_t ops;
+  bool threaded; // needs a thread-safe allocator
+} BenchWorkload;
 
-  MemoryBlock str1 = allocator->vtable->alloc(allocator, 1);
-  assert(str1.ptr != NULL);
-  assert(gpa->buckets[0] != NULL);
-  assert(gpa->buckets[0]->bucket_size == 1);
-  *(char *)str1.ptr = 'a';
+static const BenchWorkload bench_workloads[] = {
+    {"uniform", bench_uniform, 4000000, false},
+    {"mixed", bench_mixed, 2000000, false},
+    {"producer-consumer", bench_producer_consumer, 2000000, true},
+    {"larson", bench_larson, 4000000, true},
+    {"realloc-growth", bench_realloc_growth, 400000, false},
+    {"containers", bench_containers, 2000000, false},
+};
 
-  MemoryBlock str2 = allocator->vtable->alloc(allocator, 20);
-  assert(str2.ptr != NULL);
-  assert(gpa->buckets[5] != NULL);
-  memcpy(str2.ptr, "bucket5\n", 8);
+static int bench_compare(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
 
-  MemoryBlock str3 = allocator->vtable->alloc(allocator, 300);
-  assert(str3.ptr != NULL);
-  assert(gpa->buckets[9] != NULL);
-  assert(gpa->buckets[9]->bucket_size == 512);
-  memcpy(str3.ptr, "bucket9\n", 8);
+// forks so every run starts from an empty heap and has a peak rss of its own
+static void bench_workload(const BenchWorkload *workload,
+                           const BenchTarget *target) {
+  pid_t pid = fork();
+  if (pid != 0) {
+    waitpid(pid, NULL, 0);
+    return;
+  }
 
-  // can't resize to different bucket, use alloc+free instead
-  bool resize1 = allocator->vtable->resize(allocator, &str1, 2);
-  assert(resize1 == false);
-  bool resize2 = allocator->vtable->resize(allocator, &str2, 30);
-  assert(resize2 == true);
-  bool resize2_2 = allocator->vtable->resize(allocator, &str2, 1);
-  assert(resize2_2 == true);
-  assert(((char *)str2.ptr)[0] == 'b');
-  assert(((char *)str2.ptr)[1] == (char)0xAA);
+  BenchRun run = {target->create(), target, workload->ops,
+                  {map_pages(BENCH_MAX_SAMPLES * sizeof(double), 12), 0}};
+  double start = bench_now();
+  workload->run(&run);
+  double elapsed = bench_now() - start;
 
-  MemoryBlock str4;
-  GPABucket *initial_bucket = gpa->buckets[9];
-  assert(gpa->buckets[9]->prev == NULL);
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  qsort(run.samples.data, run.samples.count, sizeof(double), bench_compare);
+  size_t n = run.samples.count;
+  printf("%-18s %-16s %9.2f %9.0f %9.0f %9.1f\n", workload->name,
+         target->name, workload->ops / elapsed / 1e6,
+         n ? run.samples.data[n / 2] : 0, n ? run.samples.data[n * 99 / 100] : 0,
+         usage.ru_maxrss / 1024.0);
+  fflush(stdout);
+  _exit(0);
+}
 
-  // does overflowing create new page
-  for (int i = 0; i < 8; i++) {
-    str4 = allocator->vtable->alloc(allocator, 300);
+// ./zalloc bench [workload], no workload runs all of them
+static int bench_main(const char *only) {
+  size_t workloads = sizeof(bench_workloads) / sizeof(bench_workloads[0]);
+  size_t known = 0;
+  while (only != NULL && known < workloads &&
+         strcmp(only, bench_workloads[known].name) != 0)
+    known++;
+  if (known == workloads) {
+    fprintf(stderr, "unknown workload %s, one of:", only);
+    for (size_t w = 0; w < workloads; w++)
+      fprintf(stderr, " %s", bench_workloads[w].name);
+    fprintf(stderr, "\n");
+    return 1;
   }
-  assert(gpa->buckets[9] != initial_bucket);
-  assert(gpa->buckets[9]->prev == initial_bucket);
-
-  MemoryBlock str5 = allocator->vtable->alloc(allocator, 1);
-  *(char *)str5.ptr = 'b';
-  allocator->vtable->free(allocator, str1);
-  allocator->vtable->free(allocator, str5);
 
-  // large allocations
-  MemoryBlock str6 = allocator->vtable->alloc(allocator, 4096);
-  assert(str6.ptr != NULL);
-  assert(str6.size == 4096);
-  allocator->vtable->free(allocator, str6);
-
-  // uncomment to check whether mem has been munmap'd
-  // memset(str1.ptr, 1, 1);
-  // memset(str5.ptr, 1, 1);
-  // memset(str6.ptr, 1, 1);
+  if (only == NULL) {
+    bench_size_mapping();
+    bench_dispatch();
+  }
 
-  printf("all gpa allocator tests passed\n");
+  printf("\n%-18s %-16s %9s %9s %9s %9s\n", "workload", "allocator", "Mops/s",
+         "p50 ns", "p99 ns", "rss MiB");
+  fflush(stdout);
+  size_t targets = sizeof(bench_targets) / sizeof(bench_targets[0]);
+  for (size_t w = 0; w < workloads; w++) {
+    const BenchWorkload *workload = &bench_workloads[w];
+    if (only != NULL && strcmp(only, workload->name) != 0)
+      continue;
+    for (size_t t = 0; t < targets; t++) {
+      if (workload->threaded && !bench_targets[t].thread_safe)
+        continue;
+      bench_workload(workload, &bench_targets[t]);
+    }
+  }
+  return 0;
 }
 
-// "Why do I have to pass allocators around in Zig?"
-// because userland decides which allocation strategy to use
-// and where the data should be placed
-void alloc_hello(Allocator *allocator) {
-  const char *str = "hello world\n";
-  size_t str_size = strlen(str) + 1;
-  MemoryBlock str1 = allocator->vtable->alloc(allocator, str_size);
-  memcpy(str1.ptr, str, str_size);
-}
+int main(int argc, char **argv) {
+  if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    return bench_main(argc > 2 ? argv[2] : NULL);
+
+  test_page_memory();
 
-int main() {
   char buf[1000];
   memset(buf, 0xAA, 1000);
   Allocator *fba = create_fixed_buffer_allocator(buf, sizeof(buf));
@@ -493,8 +5863,29 @@ int main() {
   alloc_hello(gpa);
 
   test_fba(fba);
+  test_fba_thread_safe();
   test_arena(arena);
+  test_arena_reset(create_arena_allocator());
+  test_arena_save(create_arena_allocator());
+  test_zalloc();
+  test_memory_pool();
   test_gpa(gpa);
+  test_page_allocators();
+
+  Allocator *ts_gpa = create_thread_safe_gpa_allocator();
+  test_gpa_thread_safe(ts_gpa);
+  destroy_thread_safe_gpa_allocator(ts_gpa);
+
+  test_c_allocator(create_c_allocator());
+  test_stats();
+  test_alloc_many();
+  test_oom();
+  test_alloc_zeroed();
+  test_gpa_decay();
+  test_profiling(create_gpa_allocator());
+  test_debug_allocator(create_gpa_allocator());
+  test_containers();
+  test_stack_fallback(create_gpa_allocator());
 
   return 0;
 }